@@ -0,0 +1,344 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datafile_info.h"
+
+
+static const char *arg_data = "dswebWDM.dat";
+static int output_index = 0;
+
+static datafile_info info;
+
+
+static uint8_t *load_data_file(const char *datapath, uint32_t *length)
+{
+    FILE *f;
+    uint8_t *mem;
+    long datalen;
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&f, datapath, "rb")) return NULL;
+#else
+    f = fopen(datapath, "rb");
+    if (f == NULL) return NULL;
+#endif
+
+    if (fseek(f, 0, SEEK_END))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    datalen = ftell(f);
+    if (datalen <= 4)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fseek(f, 0, SEEK_SET))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    mem = (uint8_t *)malloc(datalen);
+    if (mem == NULL)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fread(mem, 1, datalen, f) != (unsigned long)datalen)
+    {
+        free(mem);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+
+    // the last 4 bytes are not part of the data passed to D77_InitializeDataFile
+    *length = datalen - 4;
+
+    return mem;
+}
+
+static int is_first_bank(int drum, unsigned int bank)
+{
+    unsigned int index;
+
+    // banks without their own slot in the program map share the slot of another bank
+    for (index = 0; index < bank; index++)
+    {
+        if (info.data[0x50 + (drum ? 0x80 : 0) + index] == info.data[0x50 + (drum ? 0x80 : 0) + bank]) return 0;
+    }
+
+    return 1;
+}
+
+static uint32_t total_size(const datafile_range *ranges, unsigned int num_ranges)
+{
+    unsigned int index;
+    uint32_t size;
+
+    size = 0;
+    for (index = 0; index < num_ranges; index++)
+    {
+        size += ranges[index].size;
+    }
+
+    return size;
+}
+
+static void print_ranges(const datafile_range *ranges, unsigned int num_ranges)
+{
+    unsigned int index;
+
+    for (index = 0; index < num_ranges; index++)
+    {
+        printf(" %u,%u", ranges[index].offset, ranges[index].size);
+    }
+    printf("\n");
+}
+
+static void list_datafile(void)
+{
+    datafile_range ranges[1 + DATAFILE_DRUMKIT_TONES * (1 + DATAFILE_TONE_SAMPLES)];
+    datafile_range range;
+    unsigned int bank, program, note, num_ranges, num_notes;
+    int index;
+
+    printf("Version: 0x%x/0x%x\n", info.version, info.subversion);
+    printf("Length: %u\n", info.length);
+    printf("Program map: offset 0x%x, %u slots\n", info.map_offset, info.num_map_slots);
+    printf("Instruments: offset 0x%x, %u records\n", info.instrument_offset, info.num_instruments);
+    printf("Drum kits: offset 0x%x, %u records\n", info.drumkit_offset, info.num_drumkits);
+    printf("Tones: offset 0x%x, %u records\n", info.tone_offset, info.num_tones);
+    printf("Samples: offset 0x%x, %u samples, %u bytes\n", info.sample_offset, info.num_samples, info.length - info.sample_offset);
+
+    printf("\nPrograms:\n");
+    for (bank = 0; bank < 128; bank++)
+    {
+        if (!is_first_bank(0, bank)) continue;
+
+        for (program = 0; program < 128; program++)
+        {
+            index = datafile_find_instrument(&info, 0, bank, program);
+            if (index < 0) continue;
+
+            num_ranges = datafile_collect_ranges(&info, 0, index, -1, ranges, sizeof(ranges) / sizeof(ranges[0]));
+            printf("  bank %3u program %3u: instrument %3i, offset 0x%06x, %2u ranges, %7u bytes\n", bank, program, index, datafile_instrument_offset(&info, 0, index), num_ranges, total_size(ranges, num_ranges));
+        }
+    }
+
+    printf("\nDrum kits:\n");
+    for (bank = 0; bank < 128; bank++)
+    {
+        if (!is_first_bank(1, bank)) continue;
+
+        for (program = 0; program < 128; program++)
+        {
+            index = datafile_find_instrument(&info, 1, bank, program);
+            if (index < 0) continue;
+
+            // list only the programs which select their own drum kit
+            if ((program != 0) && (index == datafile_find_instrument(&info, 1, bank, 0))) continue;
+
+            num_notes = 0;
+            for (note = 0; note < DATAFILE_DRUMKIT_TONES; note++)
+            {
+                if (datafile_instrument_tone(&info, 1, index, note) != DATAFILE_NONE) num_notes++;
+            }
+
+            num_ranges = datafile_collect_ranges(&info, 1, index, -1, ranges, sizeof(ranges) / sizeof(ranges[0]));
+            printf("  bank %3u program %3u: drum kit %2i, offset 0x%06x, %3u notes, %3u ranges, %7u bytes\n", bank, program, index, datafile_instrument_offset(&info, 1, index), num_notes, num_ranges, total_size(ranges, num_ranges));
+        }
+    }
+
+    printf("\nSamples:\n");
+    for (index = 0; index < (int)info.num_samples; index++)
+    {
+        range = datafile_sample_range(&info, index);
+        printf("  sample %3i: offset 0x%06x, %7u bytes\n", index, range.offset, range.size);
+    }
+}
+
+static void index_datafile(void)
+{
+    datafile_range ranges[1 + DATAFILE_DRUMKIT_TONES * (1 + DATAFILE_TONE_SAMPLES)];
+    unsigned int bank, program, note, num_ranges;
+    int index;
+
+    printf("# I bank program offset,size...\n");
+    printf("# K bank program offset,size...\n");
+    printf("# N bank program note offset,size...\n");
+
+    for (bank = 0; bank < 128; bank++)
+    {
+        if (!is_first_bank(0, bank)) continue;
+
+        for (program = 0; program < 128; program++)
+        {
+            index = datafile_find_instrument(&info, 0, bank, program);
+            if (index < 0) continue;
+
+            num_ranges = datafile_collect_ranges(&info, 0, index, -1, ranges, sizeof(ranges) / sizeof(ranges[0]));
+            printf("I %u %u", bank, program);
+            print_ranges(ranges, num_ranges);
+        }
+    }
+
+    for (bank = 0; bank < 128; bank++)
+    {
+        if (!is_first_bank(1, bank)) continue;
+
+        for (program = 0; program < 128; program++)
+        {
+            index = datafile_find_instrument(&info, 1, bank, program);
+            if (index < 0) continue;
+
+            num_ranges = datafile_collect_ranges(&info, 1, index, -1, ranges, sizeof(ranges) / sizeof(ranges[0]));
+            printf("K %u %u", bank, program);
+            print_ranges(ranges, num_ranges);
+
+            for (note = 0; note < DATAFILE_DRUMKIT_TONES; note++)
+            {
+                if (datafile_instrument_tone(&info, 1, index, note) == DATAFILE_NONE) continue;
+
+                num_ranges = datafile_collect_ranges(&info, 1, index, note, ranges, sizeof(ranges) / sizeof(ranges[0]));
+                printf("N %u %u %u", bank, program, note);
+                print_ranges(ranges, num_ranges);
+            }
+        }
+    }
+}
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "d77_datinfo";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+
+#ifdef _WIN32
+        slash = strrchr(progname, '\\');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+#endif
+    }
+
+    printf(
+        "%s - WebSynth D-77 datafile info\n"
+        "Usage: %s [OPTIONS]...\n"
+        "  -w PATH  Datafile path (path to dsweb*.dat)\n"
+        "  -x       Output byte-range index instead of listing\n"
+        "  -h       Help\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t *datafile_ptr;
+    uint32_t datafile_len;
+    int i;
+
+    // parse arguments
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'w': // data file
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_data = argv[i];
+                    }
+                    break;
+                case 'x': // index
+                    output_index = 1;
+                    break;
+                case 'h': // help
+                    usage(argv[0]);
+                default:
+                    break;
+            }
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+        }
+    }
+
+    // load DATA file
+    datafile_ptr = load_data_file(arg_data, &datafile_len);
+    if (datafile_ptr == NULL)
+    {
+        fprintf(stderr, "error loading DATA file\n");
+        return 3;
+    }
+
+    if (datafile_parse(datafile_ptr, datafile_len, &info))
+    {
+        free(datafile_ptr);
+        fprintf(stderr, "error parsing DATA file\n");
+        return 5;
+    }
+
+    if (output_index)
+    {
+        index_datafile();
+    }
+    else
+    {
+        list_datafile();
+    }
+
+    datafile_free(&info);
+    free(datafile_ptr);
+
+    return 0;
+}
@@ -0,0 +1,752 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "datafile_info.h"
+#include "midi_loader.h"
+
+#if defined(__GNUC__)
+#define INLINE __inline__
+#elif defined(_MSC_VER)
+#define INLINE __inline
+#else
+#define INLINE inline
+#endif
+
+
+#define MAX_INPUTS 4096
+
+static const char *arg_inputs[MAX_INPUTS];
+static unsigned int num_inputs = 0;
+static const char *arg_output = NULL;
+static const char *arg_data = "dswebWDM.dat";
+static unsigned int subst_bank = 0, subst_program = 0, subst_drum_program = 0, subst_drum_note = 38;
+
+static datafile_info info;
+static int subst_instrument, subst_drumkit;
+
+static uint8_t *used_instruments, *used_drumkits, *used_drumnotes, *used_tones, *used_samples;
+static uint32_t *new_sample_offsets;
+
+
+static INLINE uint32_t READ_LE_UINT32(const uint8_t *ptr)
+{
+    return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+static INLINE void WRITE_LE_UINT16(uint8_t *ptr, uint16_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+}
+
+static INLINE void WRITE_LE_UINT32(uint8_t *ptr, uint32_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+    ptr[2] = (value >> 16) & 0xff;
+    ptr[3] = (value >> 24) & 0xff;
+}
+
+
+static uint8_t *load_data_file(const char *datapath, uint32_t *length)
+{
+    FILE *f;
+    uint8_t *mem;
+    long datalen;
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&f, datapath, "rb")) return NULL;
+#else
+    f = fopen(datapath, "rb");
+    if (f == NULL) return NULL;
+#endif
+
+    if (fseek(f, 0, SEEK_END))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    datalen = ftell(f);
+    if (datalen <= 4)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fseek(f, 0, SEEK_SET))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    mem = (uint8_t *)malloc(datalen);
+    if (mem == NULL)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fread(mem, 1, datalen, f) != (unsigned long)datalen)
+    {
+        free(mem);
+        fclose(f);
+        return NULL;
+    }
+
+    fclose(f);
+
+    // the last 4 bytes are not part of the data passed to D77_InitializeDataFile
+    *length = datalen - 4;
+
+    return mem;
+}
+
+static void mark_instrument(unsigned int bank, unsigned int program)
+{
+    int index;
+
+    index = datafile_find_instrument(&info, 0, bank, program);
+    if (index >= 0) used_instruments[index] = 1;
+
+    // keep also the capital tone, in case the variation is not used
+    index = datafile_find_instrument(&info, 0, 0, program);
+    if (index >= 0) used_instruments[index] = 1;
+}
+
+static void mark_drumnote(unsigned int bank, unsigned int program, unsigned int note)
+{
+    int index;
+
+    index = datafile_find_instrument(&info, 1, bank, program);
+    if (index < 0) index = datafile_find_instrument(&info, 1, 0, program);
+    if (index < 0) return;
+
+    used_drumkits[index] = 1;
+    used_drumnotes[index * DATAFILE_DRUMKIT_TONES + note] = 1;
+}
+
+static int scan_midi_file(const char *filename)
+{
+    unsigned int timediv, index, channel, bank[16], program[16];
+    midi_event_info *midi_events, *event;
+    const uint8_t *data;
+    int drum[16];
+
+    if (load_midi_file(filename, &timediv, &midi_events)) return 0;
+
+    for (channel = 0; channel < 16; channel++)
+    {
+        bank[channel] = 0;
+        program[channel] = 0;
+        drum[channel] = (channel == 9) ? 1 : 0;
+    }
+
+    for (index = 1; index <= midi_events[0].len; index++)
+    {
+        event = &(midi_events[index]);
+        data = MIDI_EVENT_DATA(event);
+
+        if (data[0] == 0xff) continue; // skip meta events
+
+        if (data[0] == 0xf0)
+        {
+            if (((event->len >= 6) && (data[1] == 0x7e) && (data[3] == 0x09) && (data[4] == 0x01)) || // GM system on
+                ((event->len >= 10) && (data[1] == 0x41) && (data[3] == 0x42) && (data[4] == 0x12) && (data[5] == 0x40) && (data[6] == 0x00) && (data[7] == 0x7f)) // GS reset
+               )
+            {
+                for (channel = 0; channel < 16; channel++)
+                {
+                    bank[channel] = 0;
+                    program[channel] = 0;
+                    drum[channel] = (channel == 9) ? 1 : 0;
+                }
+            }
+            else if ((event->len >= 10) && (data[1] == 0x41) && (data[3] == 0x42) && (data[4] == 0x12) && (data[5] == 0x40) && ((data[6] & 0xf0) == 0x10) && (data[7] == 0x15)) // GS use for rhythm part
+            {
+                // block number to channel number
+                channel = data[6] & 0x0f;
+                channel = (channel == 0) ? 9 : ((channel <= 9) ? channel - 1 : channel);
+                drum[channel] = data[8] ? 1 : 0;
+            }
+            continue;
+        }
+
+        channel = data[0] & 0x0f;
+        switch (data[0] & 0xf0)
+        {
+            case 0xb0:
+                if (data[1] == 0) bank[channel] = data[2];
+                break;
+            case 0xc0:
+                program[channel] = data[1];
+                break;
+            case 0x90:
+                if (data[2] == 0) break;
+
+                if (drum[channel])
+                {
+                    mark_drumnote(bank[channel], program[channel], data[1]);
+                }
+                else
+                {
+                    mark_instrument(bank[channel], program[channel]);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    free_midi_data(midi_events);
+    return 1;
+}
+
+static void mark_tone(uint32_t tone_offset)
+{
+    unsigned int layer;
+    uint32_t sample_offset;
+    int sample;
+
+    if (tone_offset == DATAFILE_NONE) return;
+
+    used_tones[(tone_offset - info.tone_offset) / DATAFILE_TONE_SIZE] = 1;
+
+    for (layer = 0; layer < DATAFILE_TONE_SAMPLES; layer++)
+    {
+        sample_offset = datafile_tone_sample(&info, tone_offset, layer);
+        if (sample_offset == DATAFILE_NONE) continue;
+
+        sample = datafile_find_sample(&info, sample_offset);
+        if (sample >= 0) used_samples[sample] = 1;
+    }
+}
+
+static uint32_t get_subst_drumnote_tone(unsigned int drumkit)
+{
+    unsigned int note;
+    uint32_t tone_offset;
+
+    tone_offset = datafile_instrument_tone(&info, 1, drumkit, subst_drum_note);
+    if (tone_offset != DATAFILE_NONE) return tone_offset;
+
+    // the drum kit doesn't contain the substitute note - use the first used note instead
+    for (note = 0; note < DATAFILE_DRUMKIT_TONES; note++)
+    {
+        if (used_drumnotes[drumkit * DATAFILE_DRUMKIT_TONES + note])
+        {
+            tone_offset = datafile_instrument_tone(&info, 1, drumkit, note);
+            if (tone_offset != DATAFILE_NONE) return tone_offset;
+        }
+    }
+
+    return DATAFILE_NONE;
+}
+
+static int get_subst_sample(void)
+{
+    unsigned int tone, layer;
+    uint32_t tone_offset;
+    int sample;
+
+    // first sample of the substitute instrument (in any tone / layer)
+    for (tone = 0; tone < DATAFILE_INSTRUMENT_TONES; tone++)
+    {
+        tone_offset = datafile_instrument_tone(&info, 0, subst_instrument, tone);
+        if (tone_offset == DATAFILE_NONE) continue;
+
+        for (layer = 0; layer < DATAFILE_TONE_SAMPLES; layer++)
+        {
+            sample = datafile_find_sample(&info, datafile_tone_sample(&info, tone_offset, layer));
+            if (sample >= 0) return sample;
+        }
+    }
+
+    return -1;
+}
+
+static uint8_t *subset_datafile(uint32_t *new_length)
+{
+    uint8_t *mem, *ptr;
+    unsigned int index, tone, layer, slot, program, is_drum_slot;
+    uint32_t offset, tone_offset, sample_offset, subst_sample_offset, subst_tone_offset;
+    datafile_range range;
+    int sample;
+
+    mem = (uint8_t *)malloc(info.length + 4);
+    if (mem == NULL) return NULL;
+
+    // program map, instruments, drum kits and tones are kept in place
+    memcpy(mem, info.data, info.sample_offset);
+
+    // unused programs fall back to the substitute instrument / drum kit
+    for (slot = 0; slot < info.num_map_slots; slot++)
+    {
+        is_drum_slot = 0;
+        for (index = 0; index < 128; index++)
+        {
+            if (info.data[0xd0 + index] == slot) is_drum_slot = 1;
+        }
+
+        for (program = 0; program < 128; program++)
+        {
+            ptr = mem + info.map_offset + 2 * (slot * 128 + program);
+            index = ptr[0] | (ptr[1] << 8);
+            if (index == 0xffff) continue;
+
+            if (is_drum_slot)
+            {
+                if ((index < info.num_drumkits) && !used_drumkits[index]) WRITE_LE_UINT16(ptr, subst_drumkit);
+            }
+            else
+            {
+                if ((index < info.num_instruments) && !used_instruments[index]) WRITE_LE_UINT16(ptr, subst_instrument);
+            }
+        }
+    }
+
+    // unused notes in used drum kits fall back to the substitute note
+    for (index = 0; index < info.num_drumkits; index++)
+    {
+        if (!used_drumkits[index]) continue;
+
+        subst_tone_offset = get_subst_drumnote_tone(index);
+
+        for (tone = 0; tone < DATAFILE_DRUMKIT_TONES; tone++)
+        {
+            tone_offset = datafile_instrument_tone(&info, 1, index, tone);
+            if (tone_offset == DATAFILE_NONE) continue;
+
+            if (!used_drumnotes[index * DATAFILE_DRUMKIT_TONES + tone] && (subst_tone_offset != DATAFILE_NONE))
+            {
+                tone_offset = subst_tone_offset;
+                WRITE_LE_UINT32(mem + datafile_instrument_offset(&info, 1, index) + 0x84 + 4 * tone, tone_offset - info.tone_offset);
+            }
+
+            mark_tone(tone_offset);
+        }
+    }
+
+    for (index = 0; index < info.num_instruments; index++)
+    {
+        if (!used_instruments[index]) continue;
+
+        for (tone = 0; tone < DATAFILE_INSTRUMENT_TONES; tone++)
+        {
+            mark_tone(datafile_instrument_tone(&info, 0, index, tone));
+        }
+    }
+
+    // copy used samples
+    offset = (info.num_samples != 0) ? info.samples[0] : info.length;
+    memcpy(mem + info.sample_offset, info.data + info.sample_offset, offset - info.sample_offset);
+
+    for (index = 0; index < info.num_samples; index++)
+    {
+        if (!used_samples[index]) continue;
+
+        range = datafile_sample_range(&info, index);
+        sample_offset = READ_LE_UINT32(info.data + range.offset + 4);
+        if ((sample_offset < range.offset - info.sample_offset) || (sample_offset > range.offset - info.sample_offset + range.size))
+        {
+            // sample data outside of sample range
+            free(mem);
+            return NULL;
+        }
+
+        new_sample_offsets[index] = offset;
+
+        memcpy(mem + offset, info.data + range.offset, range.size);
+        WRITE_LE_UINT32(mem + offset + 4, sample_offset - (range.offset - offset));
+
+        offset += range.size;
+    }
+
+    // substitute sample for the tones which are not used (the substitute instrument is always kept)
+    sample = get_subst_sample();
+    if ((sample < 0) || !used_samples[sample])
+    {
+        free(mem);
+        return NULL;
+    }
+    subst_sample_offset = new_sample_offsets[sample] - info.sample_offset;
+
+    // relocate sample offsets in tones
+    for (index = 0; index < info.num_tones; index++)
+    {
+        tone_offset = info.tone_offset + index * DATAFILE_TONE_SIZE;
+
+        for (layer = 0; layer < DATAFILE_TONE_SAMPLES; layer++)
+        {
+            sample_offset = datafile_tone_sample(&info, tone_offset, layer);
+            if (sample_offset == DATAFILE_NONE) continue;
+
+            if (used_tones[index])
+            {
+                sample = datafile_find_sample(&info, sample_offset);
+                WRITE_LE_UINT32(mem + tone_offset + 4 + 12 * layer, new_sample_offsets[sample] - info.sample_offset);
+            }
+            else
+            {
+                WRITE_LE_UINT32(mem + tone_offset + 4 + 12 * layer, subst_sample_offset);
+            }
+        }
+    }
+
+    WRITE_LE_UINT32(mem + 0x28, offset);
+
+    // trailing bytes
+    memcpy(mem + offset, info.data + info.length, 4);
+
+    *new_length = offset;
+    return mem;
+}
+
+static int compare_tone(const datafile_info *new_info, uint32_t tone_offset, uint32_t new_tone_offset)
+{
+    unsigned int layer;
+    uint32_t sample_offset, new_sample_offset;
+    datafile_range range, new_range;
+    int sample, new_sample;
+
+    // tone record without the sample offsets
+    if (memcmp(info.data + tone_offset, new_info->data + new_tone_offset, 4)) return 0;
+    if (memcmp(info.data + tone_offset + 8, new_info->data + new_tone_offset + 8, 8)) return 0;
+    if (memcmp(info.data + tone_offset + 20, new_info->data + new_tone_offset + 20, DATAFILE_TONE_SIZE - 20)) return 0;
+
+    for (layer = 0; layer < DATAFILE_TONE_SAMPLES; layer++)
+    {
+        sample_offset = datafile_tone_sample(&info, tone_offset, layer);
+        new_sample_offset = datafile_tone_sample(new_info, new_tone_offset, layer);
+        if ((sample_offset == DATAFILE_NONE) || (new_sample_offset == DATAFILE_NONE))
+        {
+            if (sample_offset != new_sample_offset) return 0;
+            continue;
+        }
+
+        sample = datafile_find_sample(&info, sample_offset);
+        new_sample = datafile_find_sample(new_info, new_sample_offset);
+        if ((sample < 0) || (new_sample < 0)) return 0;
+
+        range = datafile_sample_range(&info, sample);
+        new_range = datafile_sample_range(new_info, new_sample);
+        if (range.size != new_range.size) return 0;
+
+        // sample header without the data offset and the sample data
+        if (memcmp(info.data + range.offset, new_info->data + new_range.offset, 4)) return 0;
+        if (memcmp(info.data + range.offset + 8, new_info->data + new_range.offset + 8, range.size - 8)) return 0;
+        if (READ_LE_UINT32(info.data + range.offset + 4) - (range.offset - info.sample_offset) != READ_LE_UINT32(new_info->data + new_range.offset + 4) - (new_range.offset - new_info->sample_offset)) return 0;
+    }
+
+    return 1;
+}
+
+static int verify_datafile(const uint8_t *mem, uint32_t length)
+{
+    datafile_info new_info;
+    unsigned int index, tone;
+    int retval;
+
+    if (datafile_parse(mem, length, &new_info)) return 0;
+
+    // everything which is reachable from the used programs must be unchanged
+    retval = 1;
+    for (index = 0; retval && (index < info.num_instruments); index++)
+    {
+        if (!used_instruments[index]) continue;
+
+        for (tone = 0; retval && (tone < DATAFILE_INSTRUMENT_TONES); tone++)
+        {
+            if (datafile_instrument_tone(&info, 0, index, tone) != datafile_instrument_tone(&new_info, 0, index, tone)) retval = 0;
+            else if (datafile_instrument_tone(&info, 0, index, tone) != DATAFILE_NONE)
+            {
+                retval = compare_tone(&new_info, datafile_instrument_tone(&info, 0, index, tone), datafile_instrument_tone(&new_info, 0, index, tone));
+            }
+        }
+    }
+
+    for (index = 0; retval && (index < info.num_drumkits); index++)
+    {
+        if (!used_drumkits[index]) continue;
+
+        for (tone = 0; retval && (tone < DATAFILE_DRUMKIT_TONES); tone++)
+        {
+            if (!used_drumnotes[index * DATAFILE_DRUMKIT_TONES + tone]) continue;
+
+            if (datafile_instrument_tone(&info, 1, index, tone) != datafile_instrument_tone(&new_info, 1, index, tone)) retval = 0;
+            else if (datafile_instrument_tone(&info, 1, index, tone) != DATAFILE_NONE)
+            {
+                retval = compare_tone(&new_info, datafile_instrument_tone(&info, 1, index, tone), datafile_instrument_tone(&new_info, 1, index, tone));
+            }
+        }
+    }
+
+    datafile_free(&new_info);
+    return retval;
+}
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "d77_datsubset";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+
+#ifdef _WIN32
+        slash = strrchr(progname, '\\');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+#endif
+    }
+
+    printf(
+        "%s - WebSynth D-77 datafile subset\n"
+        "Usage: %s [OPTIONS]... [MIDI FILES]...\n"
+        "  -i PATH  Input path (path to .mid, can be used multiple times)\n"
+        "  -o PATH  Output path (path to subset .dat)\n"
+        "  -w PATH  Datafile path (path to dsweb*.dat)\n"
+        "  -s BANK:PROGRAM  Substitute for unused programs (default: 0:0)\n"
+        "  -d PROGRAM:NOTE  Substitute for unused drum kits and drum notes (default: 0:38)\n"
+        "  -h       Help\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t *datafile_ptr, *subset_ptr;
+    uint32_t datafile_len, subset_len;
+    unsigned int index, num_used;
+    FILE *fout;
+    int i;
+
+    // parse arguments
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'i': // input
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        if (num_inputs < MAX_INPUTS) arg_inputs[num_inputs++] = argv[i];
+                    }
+                    break;
+                case 'o': // output
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_output = argv[i];
+                    }
+                    break;
+                case 'w': // data file
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_data = argv[i];
+                    }
+                    break;
+                case 's': // substitute program
+                    if ((i + 1) < argc)
+                    {
+                        unsigned int bank, program;
+
+                        i++;
+                        if ((2 == sscanf(argv[i], "%u:%u", &bank, &program)) && (bank < 128) && (program < 128))
+                        {
+                            subst_bank = bank;
+                            subst_program = program;
+                        }
+                    }
+                    break;
+                case 'd': // substitute drum kit and note
+                    if ((i + 1) < argc)
+                    {
+                        unsigned int program, note;
+
+                        i++;
+                        if ((2 == sscanf(argv[i], "%u:%u", &program, &note)) && (program < 128) && (note < 128))
+                        {
+                            subst_drum_program = program;
+                            subst_drum_note = note;
+                        }
+                    }
+                    break;
+                case 'h': // help
+                    usage(argv[0]);
+                default:
+                    break;
+            }
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+        }
+        else if (argv[i][0] != '-')
+        {
+            if (num_inputs < MAX_INPUTS) arg_inputs[num_inputs++] = argv[i];
+        }
+    }
+
+    if (num_inputs == 0)
+    {
+        fprintf(stderr, "no input file\n");
+        usage(argv[0]);
+    }
+    if (arg_output == NULL)
+    {
+        fprintf(stderr, "no output file\n");
+        usage(argv[0]);
+    }
+
+    // load DATA file
+    datafile_ptr = load_data_file(arg_data, &datafile_len);
+    if (datafile_ptr == NULL)
+    {
+        fprintf(stderr, "error loading DATA file\n");
+        return 3;
+    }
+
+    if (datafile_parse(datafile_ptr, datafile_len, &info))
+    {
+        fprintf(stderr, "error parsing DATA file\n");
+        return 5;
+    }
+
+    subst_instrument = datafile_find_instrument(&info, 0, subst_bank, subst_program);
+    subst_drumkit = datafile_find_instrument(&info, 1, 0, subst_drum_program);
+    if ((subst_instrument < 0) || (subst_drumkit < 0))
+    {
+        fprintf(stderr, "substitute program not found\n");
+        return 5;
+    }
+    if (get_subst_sample() < 0)
+    {
+        fprintf(stderr, "substitute program has no sample\n");
+        return 5;
+    }
+
+    used_instruments = (uint8_t *)calloc(info.num_instruments + info.num_drumkits * (1 + DATAFILE_DRUMKIT_TONES) + info.num_tones + info.num_samples + 1, 1);
+    new_sample_offsets = (uint32_t *)calloc(info.num_samples + 1, sizeof(uint32_t));
+    if ((used_instruments == NULL) || (new_sample_offsets == NULL))
+    {
+        fprintf(stderr, "error allocating memory\n");
+        return 2;
+    }
+    used_drumkits = used_instruments + info.num_instruments;
+    used_drumnotes = used_drumkits + info.num_drumkits;
+    used_tones = used_drumnotes + info.num_drumkits * DATAFILE_DRUMKIT_TONES;
+    used_samples = used_tones + info.num_tones;
+
+    // the substitutes are always kept
+    used_instruments[subst_instrument] = 1;
+    used_drumkits[subst_drumkit] = 1;
+    used_drumnotes[subst_drumkit * DATAFILE_DRUMKIT_TONES + subst_drum_note] = 1;
+
+    // find programs and drum notes used in the MIDI files
+    for (index = 0; index < num_inputs; index++)
+    {
+        if (!scan_midi_file(arg_inputs[index]))
+        {
+            fprintf(stderr, "error loading MIDI file: %s\n", arg_inputs[index]);
+            return 4;
+        }
+    }
+
+    subset_ptr = subset_datafile(&subset_len);
+    if (subset_ptr == NULL)
+    {
+        fprintf(stderr, "error creating subset of DATA file\n");
+        return 6;
+    }
+
+    if (!verify_datafile(subset_ptr, subset_len))
+    {
+        fprintf(stderr, "error verifying subset of DATA file\n");
+        return 6;
+    }
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&fout, arg_output, "wb"))
+#else
+    fout = fopen(arg_output, "wb");
+    if (fout == NULL)
+#endif
+    {
+        fprintf(stderr, "error opening output file\n");
+        return 8;
+    }
+
+    if (fwrite(subset_ptr, 1, subset_len + 4, fout) != subset_len + 4)
+    {
+        fclose(fout);
+        fprintf(stderr, "error writing to output file\n");
+        return 9;
+    }
+
+    fclose(fout);
+
+    num_used = 0;
+    for (index = 0; index < info.num_instruments; index++) num_used += used_instruments[index];
+    printf("Instruments: %u of %u\n", num_used, info.num_instruments);
+    num_used = 0;
+    for (index = 0; index < info.num_drumkits; index++) num_used += used_drumkits[index];
+    printf("Drum kits: %u of %u\n", num_used, info.num_drumkits);
+    num_used = 0;
+    for (index = 0; index < info.num_drumkits * DATAFILE_DRUMKIT_TONES; index++) num_used += used_drumnotes[index];
+    printf("Drum notes: %u\n", num_used);
+    num_used = 0;
+    for (index = 0; index < info.num_samples; index++) num_used += used_samples[index];
+    printf("Samples: %u of %u\n", num_used, info.num_samples);
+    printf("Size: %u -> %u bytes (%u bytes saved, %.1f%%)\n", datafile_len + 4, subset_len + 4, datafile_len - subset_len, (datafile_len - subset_len) * 100.0 / (datafile_len + 4));
+
+    free(subset_ptr);
+    free(new_sample_offsets);
+    free(used_instruments);
+    datafile_free(&info);
+    free(datafile_ptr);
+
+    return 0;
+}
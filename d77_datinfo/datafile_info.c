@@ -0,0 +1,338 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "datafile_info.h"
+
+
+#define GETU32FLE(buf) (                    \
+            (uint32_t) ( (buf)[0] )       | \
+            (uint32_t) ( (buf)[1] ) <<  8 | \
+            (uint32_t) ( (buf)[2] ) << 16 | \
+            (uint32_t) ( (buf)[3] ) << 24 )
+
+#define GETU16FLE(buf) (                    \
+            (uint32_t) ( (buf)[0] )       | \
+            (uint32_t) ( (buf)[1] ) <<  8 )
+
+
+static int compare_offsets(const void *a, const void *b)
+{
+    uint32_t offset_a, offset_b;
+
+    offset_a = *(const uint32_t *)a;
+    offset_b = *(const uint32_t *)b;
+
+    return (offset_a < offset_b) ? -1 : ((offset_a > offset_b) ? 1 : 0);
+}
+
+static int compare_ranges(const void *a, const void *b)
+{
+    return compare_offsets(&(((const datafile_range *)a)->offset), &(((const datafile_range *)b)->offset));
+}
+
+int datafile_parse(const uint8_t *data, uint32_t length, datafile_info *info)
+{
+    unsigned int index, layer, num_samples;
+    uint32_t tone_offset, sample_offset;
+
+    memset(info, 0, sizeof(datafile_info));
+
+    if (length < 0x150)
+    {
+        // not enough place for header
+        return 1;
+    }
+
+    info->data = data;
+    info->length = length;
+    info->version = GETU32FLE(data + 0x20);
+    info->subversion = GETU32FLE(data + 0x24);
+
+    if ((info->version != 0x200) || ((info->subversion != 0x100) && (info->subversion != 0x101)))
+    {
+        // unsupported datafile version
+        return 2;
+    }
+
+    if (GETU32FLE(data + 0x28) != length)
+    {
+        // wrong datafile length
+        return 3;
+    }
+
+    info->map_offset = GETU32FLE(data + 0x2c);
+    info->instrument_offset = GETU32FLE(data + 0x30);
+    info->drumkit_offset = GETU32FLE(data + 0x34);
+    info->tone_offset = GETU32FLE(data + 0x38);
+    info->sample_offset = GETU32FLE(data + 0x3c);
+
+    if ((info->map_offset < 0x150) ||
+        (info->instrument_offset < info->map_offset) ||
+        (info->drumkit_offset < info->instrument_offset) ||
+        (info->tone_offset < info->drumkit_offset) ||
+        (info->sample_offset < info->tone_offset) ||
+        (info->sample_offset > length)
+       )
+    {
+        // wrong table offsets
+        return 4;
+    }
+
+    info->num_map_slots = (info->instrument_offset - info->map_offset) / 256;
+    info->num_instruments = (info->drumkit_offset - info->instrument_offset) / DATAFILE_INSTRUMENT_SIZE;
+    info->num_drumkits = (info->tone_offset - info->drumkit_offset) / DATAFILE_DRUMKIT_SIZE;
+    info->num_tones = (info->sample_offset - info->tone_offset) / DATAFILE_TONE_SIZE;
+
+    for (index = 0; index < 256; index++)
+    {
+        if (data[0x50 + index] >= info->num_map_slots)
+        {
+            // wrong program map slot
+            return 5;
+        }
+    }
+
+    // collect sample headers referenced by tones
+    info->samples = (uint32_t *) malloc(info->num_tones * DATAFILE_TONE_SAMPLES * sizeof(uint32_t));
+    if ((info->samples == NULL) && (info->num_tones != 0))
+    {
+        return 6;
+    }
+
+    num_samples = 0;
+    for (index = 0; index < info->num_tones; index++)
+    {
+        tone_offset = info->tone_offset + index * DATAFILE_TONE_SIZE;
+
+        for (layer = 0; layer < DATAFILE_TONE_SAMPLES; layer++)
+        {
+            sample_offset = datafile_tone_sample(info, tone_offset, layer);
+            if (sample_offset == DATAFILE_NONE) continue;
+
+            if (sample_offset + DATAFILE_SAMPLE_HEADER_SIZE > length)
+            {
+                // wrong sample offset
+                datafile_free(info);
+                return 7;
+            }
+
+            info->samples[num_samples] = sample_offset;
+            num_samples++;
+        }
+    }
+
+    qsort(info->samples, num_samples, sizeof(uint32_t), compare_offsets);
+
+    // remove duplicates
+    info->num_samples = 0;
+    for (index = 0; index < num_samples; index++)
+    {
+        if ((info->num_samples == 0) || (info->samples[info->num_samples - 1] != info->samples[index]))
+        {
+            info->samples[info->num_samples] = info->samples[index];
+            info->num_samples++;
+        }
+    }
+
+    return 0;
+}
+
+void datafile_free(datafile_info *info)
+{
+    if (info->samples != NULL)
+    {
+        free(info->samples);
+        info->samples = NULL;
+    }
+    info->num_samples = 0;
+}
+
+int datafile_find_instrument(const datafile_info *info, int drum, unsigned int bank, unsigned int program)
+{
+    unsigned int slot, index;
+
+    if ((bank >= 128) || (program >= 128)) return -1;
+
+    // same lookup as in loc_405910
+    slot = info->data[0x50 + (drum ? 0x80 : 0) + bank];
+    index = GETU16FLE(info->data + info->map_offset + 2 * (slot * 128 + program));
+
+    if (index == 0xffff) return -1;
+    if (index >= (drum ? info->num_drumkits : info->num_instruments)) return -1;
+
+    return index;
+}
+
+uint32_t datafile_instrument_offset(const datafile_info *info, int drum, unsigned int index)
+{
+    if (drum)
+    {
+        return info->drumkit_offset + index * DATAFILE_DRUMKIT_SIZE;
+    }
+    else
+    {
+        return info->instrument_offset + index * DATAFILE_INSTRUMENT_SIZE;
+    }
+}
+
+uint32_t datafile_instrument_tone(const datafile_info *info, int drum, unsigned int index, unsigned int tone)
+{
+    uint32_t offset;
+
+    if (tone >= (drum ? DATAFILE_DRUMKIT_TONES : DATAFILE_INSTRUMENT_TONES)) return DATAFILE_NONE;
+
+    offset = GETU32FLE(info->data + datafile_instrument_offset(info, drum, index) + (drum ? 0x84 : 0x14) + 4 * tone);
+    if (offset == DATAFILE_NONE) return DATAFILE_NONE;
+
+    offset += info->tone_offset;
+    if ((offset < info->tone_offset) || (offset + DATAFILE_TONE_SIZE > info->sample_offset)) return DATAFILE_NONE;
+
+    return offset;
+}
+
+uint32_t datafile_tone_sample(const datafile_info *info, uint32_t tone_offset, unsigned int layer)
+{
+    uint32_t offset;
+
+    if (layer >= DATAFILE_TONE_SAMPLES) return DATAFILE_NONE;
+
+    offset = GETU32FLE(info->data + tone_offset + 4 + 12 * layer);
+    if (offset == DATAFILE_NONE) return DATAFILE_NONE;
+
+    offset += info->sample_offset;
+    if ((offset < info->sample_offset) || (offset >= info->length)) return DATAFILE_NONE;
+
+    return offset;
+}
+
+int datafile_find_sample(const datafile_info *info, uint32_t sample_offset)
+{
+    unsigned int low, high, middle;
+
+    low = 0;
+    high = info->num_samples;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (info->samples[middle] == sample_offset) return middle;
+
+        if (info->samples[middle] < sample_offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return -1;
+}
+
+datafile_range datafile_sample_range(const datafile_info *info, unsigned int sample)
+{
+    datafile_range range;
+
+    // sample data continues up to the next sample header
+    range.offset = info->samples[sample];
+    range.size = ((sample + 1 < info->num_samples) ? info->samples[sample + 1] : info->length) - range.offset;
+
+    return range;
+}
+
+unsigned int datafile_collect_ranges(const datafile_info *info, int drum, unsigned int index, int note, datafile_range *ranges, unsigned int max_ranges)
+{
+    datafile_range collected[1 + DATAFILE_DRUMKIT_TONES * (1 + DATAFILE_TONE_SAMPLES)];
+    unsigned int num_collected, num_ranges, tone, first_tone, last_tone, layer;
+    uint32_t tone_offset, sample_offset;
+    int sample;
+
+    num_collected = 0;
+
+    collected[num_collected].offset = datafile_instrument_offset(info, drum, index);
+    collected[num_collected].size = drum ? DATAFILE_DRUMKIT_SIZE : DATAFILE_INSTRUMENT_SIZE;
+    num_collected++;
+
+    if (drum && (note >= 0))
+    {
+        first_tone = last_tone = note;
+    }
+    else
+    {
+        // all tones of the instrument are collected, because the key splits are not decoded
+        first_tone = 0;
+        last_tone = (drum ? DATAFILE_DRUMKIT_TONES : DATAFILE_INSTRUMENT_TONES) - 1;
+    }
+
+    for (tone = first_tone; tone <= last_tone; tone++)
+    {
+        tone_offset = datafile_instrument_tone(info, drum, index, tone);
+        if (tone_offset == DATAFILE_NONE) continue;
+
+        collected[num_collected].offset = tone_offset;
+        collected[num_collected].size = DATAFILE_TONE_SIZE;
+        num_collected++;
+
+        for (layer = 0; layer < DATAFILE_TONE_SAMPLES; layer++)
+        {
+            sample_offset = datafile_tone_sample(info, tone_offset, layer);
+            if (sample_offset == DATAFILE_NONE) continue;
+
+            sample = datafile_find_sample(info, sample_offset);
+            if (sample < 0) continue;
+
+            collected[num_collected] = datafile_sample_range(info, sample);
+            num_collected++;
+        }
+    }
+
+    qsort(collected, num_collected, sizeof(datafile_range), compare_ranges);
+
+    // merge overlapping and adjacent ranges
+    num_ranges = 0;
+    for (tone = 0; tone < num_collected; tone++)
+    {
+        if ((num_ranges != 0) && (collected[tone].offset <= collected[num_ranges - 1].offset + collected[num_ranges - 1].size))
+        {
+            if (collected[tone].offset + collected[tone].size > collected[num_ranges - 1].offset + collected[num_ranges - 1].size)
+            {
+                collected[num_ranges - 1].size = collected[tone].offset + collected[tone].size - collected[num_ranges - 1].offset;
+            }
+        }
+        else
+        {
+            collected[num_ranges] = collected[tone];
+            num_ranges++;
+        }
+    }
+
+    if (ranges != NULL)
+    {
+        memcpy(ranges, collected, ((num_ranges < max_ranges) ? num_ranges : max_ranges) * sizeof(datafile_range));
+    }
+
+    return num_ranges;
+}
@@ -0,0 +1,89 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#if !defined(_DATAFILE_INFO_H_INCLUDED_)
+#define _DATAFILE_INFO_H_INCLUDED_
+
+#include <stdint.h>
+
+// Datafile layout (as consumed by InitializeDataFile_asm):
+//   0x20  version (0x200)
+//   0x24  subversion (0x100/0x101)
+//   0x28  length (datafile length without the 4 trailing bytes)
+//   0x2c  offset of program map (slots of 128 x uint16 instrument/drum kit indexes)
+//   0x30  offset of instruments (0x54 bytes each, 16 tone offsets at +0x14)
+//   0x34  offset of drum kits (0x284 bytes each, 128 tone offsets at +0x84)
+//   0x38  offset of tones (0x50 bytes each, 2 sample offsets at +0x04 and +0x10)
+//   0x3c  offset of samples (0x18 bytes header followed by sample data)
+//   0x50  bank -> program map slot (128 bytes for instruments, 128 bytes for drum kits)
+// Tone offsets are relative to the tones, sample offsets are relative to the samples, 0xffffffff means no tone/sample.
+
+#define DATAFILE_NONE 0xffffffff
+
+#define DATAFILE_INSTRUMENT_SIZE 0x54
+#define DATAFILE_DRUMKIT_SIZE 0x284
+#define DATAFILE_TONE_SIZE 0x50
+#define DATAFILE_SAMPLE_HEADER_SIZE 0x18
+
+#define DATAFILE_INSTRUMENT_TONES 16
+#define DATAFILE_DRUMKIT_TONES 128
+#define DATAFILE_TONE_SAMPLES 2
+
+typedef struct
+{
+    uint32_t offset;
+    uint32_t size;
+} datafile_range;
+
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t length;
+    uint32_t version, subversion;
+    uint32_t map_offset, instrument_offset, drumkit_offset, tone_offset, sample_offset;
+    unsigned int num_map_slots, num_instruments, num_drumkits, num_tones, num_samples;
+    uint32_t *samples; // sorted offsets of sample headers
+} datafile_info;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int datafile_parse(const uint8_t *data, uint32_t length, datafile_info *info);
+extern void datafile_free(datafile_info *info);
+
+extern int datafile_find_instrument(const datafile_info *info, int drum, unsigned int bank, unsigned int program);
+extern uint32_t datafile_instrument_offset(const datafile_info *info, int drum, unsigned int index);
+extern uint32_t datafile_instrument_tone(const datafile_info *info, int drum, unsigned int index, unsigned int tone);
+extern uint32_t datafile_tone_sample(const datafile_info *info, uint32_t tone_offset, unsigned int layer);
+extern int datafile_find_sample(const datafile_info *info, uint32_t sample_offset);
+extern datafile_range datafile_sample_range(const datafile_info *info, unsigned int sample);
+
+extern unsigned int datafile_collect_ranges(const datafile_info *info, int drum, unsigned int index, int note, datafile_range *ranges, unsigned int max_ranges);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
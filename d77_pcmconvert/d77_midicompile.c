@@ -0,0 +1,332 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "midi_loader.h"
+
+
+#define MAX_INPUTS 4096
+
+static const char *arg_inputs[MAX_INPUTS];
+static unsigned int num_inputs = 0;
+static const char *arg_output = NULL;
+static int arg_force = 0;
+
+static unsigned int num_compiled = 0, num_uptodate = 0, num_errors = 0;
+
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "d77_midicompile";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+    }
+
+    printf(
+        "%s - WebSynth D-77 MIDI compiler\n"
+        "Usage: %s [OPTIONS]... [MIDI FILES / DIRECTORIES]...\n"
+        "  -i PATH  Input path (path to .mid or to directory with .mid files, can be used multiple times)\n"
+        "  -o PATH  Output directory (default: same directory as the input file)\n"
+        "  -f       Compile even if the compiled file is up to date\n"
+        "  -h       Help\n"
+        "Compiled files (.d77m) can be used instead of .mid files by d77_pcmconvert.\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+static int is_midi_file(const char *name)
+{
+    const char *ext;
+
+    ext = strrchr(name, '.');
+    if (ext == NULL) return 0;
+
+    return (strcasecmp(ext, ".mid") == 0) || (strcasecmp(ext, ".midi") == 0) || (strcasecmp(ext, ".kar") == 0) || (strcasecmp(ext, ".smf") == 0);
+}
+
+static char *get_output_path(const char *input_path)
+{
+    const char *name, *ext;
+    char *output_path;
+    size_t dirlen, namelen;
+
+    name = strrchr(input_path, '/');
+    name = (name != NULL) ? name + 1 : input_path;
+
+    ext = strrchr(name, '.');
+    namelen = (ext != NULL) ? (size_t)(ext - name) : strlen(name);
+
+    if (arg_output != NULL)
+    {
+        dirlen = strlen(arg_output);
+    }
+    else
+    {
+        dirlen = name - input_path;
+    }
+
+    output_path = (char *) malloc(dirlen + namelen + 7);
+    if (output_path == NULL) return NULL;
+
+    if (arg_output != NULL)
+    {
+        memcpy(output_path, arg_output, dirlen);
+        if ((dirlen != 0) && (output_path[dirlen - 1] != '/')) output_path[dirlen++] = '/';
+    }
+    else
+    {
+        memcpy(output_path, input_path, dirlen);
+    }
+
+    memcpy(output_path + dirlen, name, namelen);
+    strcpy(output_path + dirlen + namelen, ".d77m");
+
+    return output_path;
+}
+
+static uint8_t *read_source(const char *path, unsigned int *size)
+{
+    FILE *f;
+    long fsize;
+    uint8_t *data;
+
+    f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+
+    data = NULL;
+    if (fseek(f, 0, SEEK_END)) goto read_error;
+    fsize = ftell(f);
+    if ((fsize <= 0) || (fsize > 0x7fffffff)) goto read_error;
+    if (fseek(f, 0, SEEK_SET)) goto read_error;
+
+    data = (uint8_t *) malloc(fsize);
+    if (data == NULL) goto read_error;
+
+    if (fread(data, 1, fsize, f) != (unsigned long)fsize) goto read_error;
+
+    fclose(f);
+    *size = fsize;
+    return data;
+
+read_error:
+    free(data);
+    fclose(f);
+    return NULL;
+}
+
+static void compile_file(const char *input_path)
+{
+    struct stat input_stat, output_stat;
+    midi_event_info *events;
+    unsigned int timediv, size;
+    char *output_path;
+    uint8_t *midi;
+    int retval;
+
+    output_path = get_output_path(input_path);
+    if (output_path == NULL)
+    {
+        fprintf(stderr, "error allocating memory\n");
+        num_errors++;
+        return;
+    }
+
+    // skip files which are up to date
+    if (!arg_force && (stat(input_path, &input_stat) == 0) && (stat(output_path, &output_stat) == 0) && (output_stat.st_mtime >= input_stat.st_mtime))
+    {
+        num_uptodate++;
+        free(output_path);
+        return;
+    }
+
+    midi = read_source(input_path, &size);
+    if (midi == NULL)
+    {
+        fprintf(stderr, "error reading MIDI file: %s\n", input_path);
+        num_errors++;
+        free(output_path);
+        return;
+    }
+
+    retval = load_midi_data(midi, size, &timediv, &events);
+    if (retval)
+    {
+        fprintf(stderr, "error loading MIDI file (%i): %s\n", retval, input_path);
+        num_errors++;
+        free(midi);
+        free(output_path);
+        return;
+    }
+
+    retval = save_compiled_midi(output_path, events, timediv, size, midi_checksum(midi, size));
+    if (retval)
+    {
+        fprintf(stderr, "error writing compiled file (%i): %s\n", retval, output_path);
+        num_errors++;
+    }
+    else
+    {
+        printf("%s -> %s (%u events)\n", input_path, output_path, events[0].len);
+        num_compiled++;
+    }
+
+    free_midi_data(events);
+    free(midi);
+    free(output_path);
+}
+
+static void compile_directory(const char *dir_path)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char *path;
+    size_t dirlen;
+
+    dir = opendir(dir_path);
+    if (dir == NULL)
+    {
+        fprintf(stderr, "error opening directory: %s\n", dir_path);
+        num_errors++;
+        return;
+    }
+
+    dirlen = strlen(dir_path);
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (!is_midi_file(entry->d_name)) continue;
+
+        path = (char *) malloc(dirlen + strlen(entry->d_name) + 2);
+        if (path == NULL)
+        {
+            fprintf(stderr, "error allocating memory\n");
+            num_errors++;
+            break;
+        }
+
+        strcpy(path, dir_path);
+        if ((dirlen != 0) && (path[dirlen - 1] != '/')) strcat(path, "/");
+        strcat(path, entry->d_name);
+
+        compile_file(path);
+        free(path);
+    }
+
+    closedir(dir);
+}
+
+int main(int argc, char *argv[])
+{
+    struct stat statbuf;
+    unsigned int index;
+    int i;
+
+    // parse arguments
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'i': // input
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        if (num_inputs < MAX_INPUTS) arg_inputs[num_inputs++] = argv[i];
+                    }
+                    break;
+                case 'o': // output
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        arg_output = argv[i];
+                    }
+                    break;
+                case 'f': // force
+                    arg_force = 1;
+                    break;
+                case 'h': // help
+                    usage(argv[0]);
+                default:
+                    break;
+            }
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+        }
+        else if (argv[i][0] != '-')
+        {
+            if (num_inputs < MAX_INPUTS) arg_inputs[num_inputs++] = argv[i];
+        }
+    }
+
+    if (num_inputs == 0)
+    {
+        fprintf(stderr, "no input file\n");
+        usage(argv[0]);
+    }
+
+    if ((arg_output != NULL) && ((stat(arg_output, &statbuf) != 0) || !S_ISDIR(statbuf.st_mode)))
+    {
+        fprintf(stderr, "output directory not found\n");
+        return 2;
+    }
+
+    for (index = 0; index < num_inputs; index++)
+    {
+        if ((stat(arg_inputs[index], &statbuf) == 0) && S_ISDIR(statbuf.st_mode))
+        {
+            compile_directory(arg_inputs[index]);
+        }
+        else
+        {
+            compile_file(arg_inputs[index]);
+        }
+    }
+
+    printf("Compiled: %u, up to date: %u, errors: %u\n", num_compiled, num_uptodate, num_errors);
+
+    return (num_errors != 0) ? 4 : 0;
+}
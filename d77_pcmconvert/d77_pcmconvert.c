@@ -23,10 +23,18 @@
  */
 
 #define _FILE_OFFSET_BITS 64
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <stddef.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
 #include "midi_loader.h"
+#include "d77_render.h"
 
 #include "websynth.h"
 
@@ -39,7 +47,25 @@
     #include <fcntl.h>
 #else
     #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <sys/time.h>
+    #include <sys/resource.h>
+    #include <sys/wait.h>
     #include <dirent.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <unistd.h>
+#ifdef __linux__
+    #include <elf.h>
+    #include <sys/ioctl.h>
+    #include <sys/sendfile.h>
+    #include <linux/fs.h>
+#endif
+#ifdef __APPLE__
+    #include <mach-o/dyld.h>
+#endif
 #endif
 
 #if defined(_MSC_VER)
@@ -78,34 +104,165 @@ static const char *arg_input = NULL;
 static const char *arg_output = NULL;
 static const char *arg_data = "dswebWDM.dat";
 #ifdef INDIRECT_64BIT
-#ifdef _WIN32
+#if defined(EMBEDDED_LIBRARY)
+static const char *arg_lib = NULL; // use embedded library
+#elif defined(_WIN32)
 static const char *arg_lib = "d77_lib.dll";
 #else
 static const char *arg_lib = "d77_lib.so";
 #endif
 #endif
 static int wav_to_file = 1;
+static int direct_output = 0;
+static uint32_t arg_start = 0;
+static uint32_t arg_end = 0;
+static unsigned int arg_preroll = 3000;
+static int print_stats = 0;
+static int tail_mode = 0;
+static unsigned int arg_tail_window = 1000;
+static unsigned int arg_tail_threshold = 8;
+static unsigned int arg_tail_max = 15000;
+static int optimize_mode = 0;
+static unsigned int optimize_dropped = 0;
+static double optimize_time = 0;
+#ifndef _WIN32
+static const char *arg_list = NULL;
+static const char *arg_outdir = NULL;
+static unsigned int arg_jobs = 0;
+static int batch_mode = 0;
+static int playlist_mode = 0;
+static unsigned int arg_gap = 0;
+static int sweep_mode = 0;
+
+static unsigned int arg_segments = 0;
+static unsigned int arg_crossfade = 20;
+static int validate_mode = 0; // meaning depends on mode (segments, optimize)
+static int hash_output = 0;
+static uint64_t output_hash;
+static int bench_mode = 0;
+static unsigned int bench_parse_tracks = 0;
+static unsigned int bench_parse_events = 0;
+static double startup_time;
+static int estimate_mode = 0;
+static const char *calibration_path = NULL;
+static double calibration_base, calibration_voice;
+static const char *cache_dir = NULL;
+static uint64_t cache_size = 1024 * 1024 * 1024;
+static int cache_hardlink = 0;
+static uint64_t datafile_hash, library_hash;
+
+static unsigned int num_batch_inputs = 0;
+static const char **batch_inputs = NULL;
 
-static uint32_t current_time;
+typedef struct
+{
+    unsigned int index;
+    const char *input_path;
+    char *output_path;
+    uint64_t input_size;
+    uint32_t duration;
+    pid_t pid;
+    int result;
+    double start_time, wall_time, cpu_time;
+} batch_job;
+#endif
 
 static unsigned int timediv;
 static midi_event_info *midi_events;
+static midi_stream *input_stream;
+static int stream_error;
 
 static D77_SETINGS d77_settings;
-static D77_PARAMETERS *d77_parameters;
 
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-static uint8_t *input_buffer;
-#else
-static D77_PARAMETERS d77_param_buffer;
-#endif
+#ifndef _WIN32
+#define MAX_SWEEP_PARAMS 16
+#define MAX_SWEEP_VALUES 64
+#define MAX_SWEEP_VARIANTS 4096
+
+static const struct {
+    const char *name;
+    size_t offset;
+    int min, max;
+} sweep_params[] = {
+    { "Freq",       offsetof(D77_SETINGS, dwSamplingFreq), 22050, 44100 },
+    { "Polyphony",  offsetof(D77_SETINGS, dwPolyphony),    8, 256 },
+    { "CpuLoad",    offsetof(D77_SETINGS, dwCpuLoadL),     20, 85 },
+    { "MVol",       offsetof(D77_SETINGS, dwMVol),         0, 200 },
+    { "RevSw",      offsetof(D77_SETINGS, dwRevSw),        0, 1 },
+    { "ChoSw",      offsetof(D77_SETINGS, dwChoSw),        0, 1 },
+    { "RevAdj",     offsetof(D77_SETINGS, dwRevAdj),       0, 200 },
+    { "ChoAdj",     offsetof(D77_SETINGS, dwChoAdj),       0, 200 },
+    { "OutLev",     offsetof(D77_SETINGS, dwOutLev),       0, 200 },
+    { "RevFb",      offsetof(D77_SETINGS, dwRevFb),        0, 200 },
+    { "RevDrm",     offsetof(D77_SETINGS, dwRevDrm),       0, 200 },
+    { "ResoUpAdj",  offsetof(D77_SETINGS, dwResoUpAdj),    0, 100 },
+};
+
+typedef struct
+{
+    unsigned int param;
+    unsigned int num_values;
+    uint32_t values[MAX_SWEEP_VALUES];
+} sweep_dimension;
 
-static int datafile_len;
-static uint8_t *datafile_ptr;
+typedef struct
+{
+    D77_SETINGS settings;
+    char label[256];
+    char *output_path;
+    pid_t pid;
+    int result;
+    double start_time, wall_time, cpu_time;
+    // filled by the worker process
+    double duration, render_time, rms;
+    unsigned int peak;
+} sweep_variant;
+
+static const char *arg_sweep_file = NULL;
+static unsigned int num_sweep_dimensions = 0;
+static sweep_dimension sweep_dimensions[MAX_SWEEP_PARAMS];
+#endif
+static d77r_renderer *renderer;
 
+// values of the initialized renderer
 static int16_t *output_buffer;
 static unsigned int frequency, bytes_per_call, samples_per_call;
 
+#define OUTPUT_CHUNK_SIZE (1024 * 1024)
+#define OUTPUT_CHUNK_ALIGN 4096
+#define OUTPUT_NUM_CHUNKS 4
+
+#define BENCH_PARSE_RUNS 5
+// voice simulation for render cost estimate (times in ms)
+#define ESTIMATE_RELEASE_TIME 300
+#define ESTIMATE_DRUM_TIME 500
+#define ESTIMATE_INTERVAL 1000
+// calibration: render cost measured with organ notes (sustained) at several voice counts
+#define CALIBRATION_LEVELS 5
+#define CALIBRATION_SECONDS 2
+#define CALIBRATION_PROGRAM 16
+
+typedef struct
+{
+#ifdef _WIN32
+    FILE *f;
+#else
+    int fd;
+    int direct, threaded;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_full, cond_empty;
+#endif
+    int is_file, finished, error;
+    uint8_t *chunks[OUTPUT_NUM_CHUNKS];
+    unsigned int chunk_len[OUTPUT_NUM_CHUNKS];
+    unsigned int fill_index, write_index, num_full;
+} output_stream;
+
+#ifndef _WIN32
+static output_stream *playlist_output = NULL;
+static uint64_t playlist_length;
+#endif
 
 static INLINE void WRITE_LE_UINT16(uint8_t *ptr, uint16_t value)
 {
@@ -122,241 +279,3855 @@ static INLINE void WRITE_LE_UINT32(uint8_t *ptr, uint32_t value)
 }
 
 
-static uint8_t *load_data_file(const char *datapath, int *length)
+static double get_time(void)
 {
-    FILE *f;
-    uint8_t *mem;
-    long datalen;
+#ifdef _WIN32
+    return clock() / (double)CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
 
-#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
-    if (fopen_s(&f, datapath, "rb"))
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+static int write_data(output_stream *out, const uint8_t *data, unsigned int size)
+{
+#ifdef _WIN32
+    return (fwrite(data, 1, size, out->f) == size) ? 1 : 0;
 #else
-    f = fopen(datapath, "rb");
+    ssize_t written;
+
+    while (size != 0)
+    {
+        written = write(out->fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return 1;
 #endif
-    if (f == NULL)
+}
+
+static void disable_direct_output(output_stream *out)
+{
+#if !defined(_WIN32) && defined(O_DIRECT)
+    if (out->direct)
+    {
+        fcntl(out->fd, F_SETFL, fcntl(out->fd, F_GETFL) & ~O_DIRECT);
+        out->direct = 0;
+    }
+#endif
+}
+
+static int write_chunk(output_stream *out, unsigned int index)
+{
+    // only whole chunks are aligned for O_DIRECT (the last chunk is usually not whole)
+    if (out->chunk_len[index] != OUTPUT_CHUNK_SIZE)
     {
+        disable_direct_output(out);
+    }
+
+    return write_data(out, out->chunks[index], out->chunk_len[index]);
+}
+
 #ifndef _WIN32
-        char *pathcopy, *slash, *filename;
-        DIR *dir;
-        struct dirent *entry;
+static void *output_thread(void *arg)
+{
+    output_stream *out;
+    unsigned int index;
+    int error;
 
-        pathcopy = strdup(datapath);
-        if (pathcopy == NULL) return NULL;
+    out = (output_stream *)arg;
+    error = 0;
 
-        slash = strrchr(pathcopy, '/');
-        if (slash != NULL)
+    pthread_mutex_lock(&out->mutex);
+    while (1)
+    {
+        while ((out->num_full == 0) && !out->finished)
         {
-            filename = slash + 1;
-            if (slash != pathcopy)
-            {
-                *slash = 0;
-                dir = opendir(pathcopy);
-                *slash = '/';
-            }
-            else
-            {
-                dir = opendir("/");
-            }
+            pthread_cond_wait(&out->cond_full, &out->mutex);
         }
-        else
+        if (out->num_full == 0) break;
+
+        index = out->write_index;
+        pthread_mutex_unlock(&out->mutex);
+
+        // after an error, the remaining chunks are discarded
+        if (!error && !write_chunk(out, index))
         {
-            filename = pathcopy;
-            dir = opendir(".");
+            error = 1;
         }
 
-        if (dir == NULL)
+        pthread_mutex_lock(&out->mutex);
+        out->error = error;
+        out->write_index = (index + 1) % OUTPUT_NUM_CHUNKS;
+        out->num_full--;
+        pthread_cond_signal(&out->cond_empty);
+    }
+    pthread_mutex_unlock(&out->mutex);
+
+    return NULL;
+}
+#endif
+
+static int submit_chunk(output_stream *out)
+{
+#ifndef _WIN32
+    int error;
+
+    if (out->threaded)
+    {
+        pthread_mutex_lock(&out->mutex);
+        out->num_full++;
+        pthread_cond_signal(&out->cond_full);
+        while (out->num_full == OUTPUT_NUM_CHUNKS)
         {
-            free(pathcopy);
-            return NULL;
+            pthread_cond_wait(&out->cond_empty, &out->mutex);
         }
+        error = out->error;
+        pthread_mutex_unlock(&out->mutex);
 
-        while (1)
-        {
-            entry = readdir(dir);
-            if (entry == NULL) break;
+        out->fill_index = (out->fill_index + 1) % OUTPUT_NUM_CHUNKS;
+        out->chunk_len[out->fill_index] = 0;
 
-            if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_REG && entry->d_type != DT_LNK) continue;
+        return error ? 0 : 1;
+    }
+#endif
 
-            if (0 != strcasecmp(filename, entry->d_name)) continue;
+    if (!write_chunk(out, out->fill_index)) return 0;
 
-            strcpy(filename, entry->d_name);
-            break;
-        };
+    out->chunk_len[out->fill_index] = 0;
+    return 1;
+}
+
+static int output_open(output_stream *out, const char *path)
+{
+    unsigned int index;
 
-        closedir(dir);
+    memset(out, 0, sizeof(output_stream));
 
-        if (entry == NULL)
+    // output is written in big chunks, the chunks are written by a separate thread while the next chunks are rendered
+    for (index = 0; index < OUTPUT_NUM_CHUNKS; index++)
+    {
+#ifdef _WIN32
+        out->chunks[index] = (uint8_t *)malloc(OUTPUT_CHUNK_SIZE);
+        if (out->chunks[index] == NULL) goto error;
+#else
+        if (posix_memalign((void **)&(out->chunks[index]), OUTPUT_CHUNK_ALIGN, OUTPUT_CHUNK_SIZE))
         {
-            free(pathcopy);
-            return NULL;
+            out->chunks[index] = NULL;
+            goto error;
         }
+#endif
+    }
 
+    if (path != NULL)
+    {
+        out->is_file = 1;
+#ifdef _WIN32
 #if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
-        if (fopen_s(&f, pathcopy, "rb"))
+        if (fopen_s(&(out->f), path, "wb")) goto error;
 #else
-        f = fopen(pathcopy, "rb");
-        if (f == NULL)
+        out->f = fopen(path, "wb");
+        if (out->f == NULL) goto error;
 #endif
+#else
+        out->fd = -1;
+#ifdef O_DIRECT
+        if (direct_output)
         {
-            free(pathcopy);
-            return NULL;
+            out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+            if (out->fd >= 0) out->direct = 1;
         }
-
-        free(pathcopy);
+#endif
+        if (out->fd < 0)
+        {
+            out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (out->fd < 0) goto error;
+        }
+#endif
+    }
+    else
+    {
+#ifdef _WIN32
+        if (_setmode(_fileno(stdout), _O_BINARY) == -1) goto error;
+        out->f = stdout;
 #else
-        return NULL;
+        fflush(stdout);
+        out->fd = STDOUT_FILENO;
 #endif
     }
 
-    if (fseek(f, 0, SEEK_END))
+#ifndef _WIN32
+    if (!pthread_mutex_init(&out->mutex, NULL))
     {
-        fclose(f);
-        return NULL;
+        if (!pthread_cond_init(&out->cond_full, NULL))
+        {
+            if (!pthread_cond_init(&out->cond_empty, NULL))
+            {
+                if (!pthread_create(&out->thread, NULL, output_thread, out))
+                {
+                    out->threaded = 1;
+                    return 1;
+                }
+                pthread_cond_destroy(&out->cond_empty);
+            }
+            pthread_cond_destroy(&out->cond_full);
+        }
+        pthread_mutex_destroy(&out->mutex);
     }
+#endif
 
-    datalen = ftell(f);
-    if (datalen <= 4)
+    // without thread, the chunks are written synchronously
+    return 1;
+
+error:
+    for (index = 0; index < OUTPUT_NUM_CHUNKS; index++)
     {
-        fclose(f);
-        return NULL;
+        free(out->chunks[index]);
+        out->chunks[index] = NULL;
     }
+    return 0;
+}
+
+static int output_write(output_stream *out, const void *data, unsigned int size)
+{
+    unsigned int len;
 
-    if (fseek(f, 0, SEEK_SET))
+    while (size != 0)
     {
-        fclose(f);
-        return NULL;
+        len = OUTPUT_CHUNK_SIZE - out->chunk_len[out->fill_index];
+        if (len > size) len = size;
+
+        memcpy(out->chunks[out->fill_index] + out->chunk_len[out->fill_index], data, len);
+        out->chunk_len[out->fill_index] += len;
+        data = len + (const uint8_t *)data;
+        size -= len;
+
+        if (out->chunk_len[out->fill_index] == OUTPUT_CHUNK_SIZE)
+        {
+            if (!submit_chunk(out)) return 0;
+        }
     }
 
+    return 1;
+}
 
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-    mem = (uint8_t *)D77_AllocateMemory(datalen);
-#else
-    mem = (uint8_t *)malloc(datalen);
-#endif
-    if (mem == NULL)
+static int output_flush(output_stream *out)
+{
+    int ok;
+
+    ok = 1;
+    if (out->chunk_len[out->fill_index] != 0)
     {
-        fclose(f);
-        return NULL;
+        ok = submit_chunk(out);
     }
 
-    if (fread(mem, 1, datalen, f) != (unsigned long)datalen)
+#ifndef _WIN32
+    if (out->threaded)
     {
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-        D77_FreeMemory(mem, datalen);
+        pthread_mutex_lock(&out->mutex);
+        out->finished = 1;
+        pthread_cond_signal(&out->cond_full);
+        pthread_mutex_unlock(&out->mutex);
+
+        pthread_join(out->thread, NULL);
+        pthread_cond_destroy(&out->cond_empty);
+        pthread_cond_destroy(&out->cond_full);
+        pthread_mutex_destroy(&out->mutex);
+        out->threaded = 0;
+
+        if (out->error) ok = 0;
+    }
+#endif
+
+    disable_direct_output(out);
+
+#ifdef _WIN32
+    if (fflush(out->f)) ok = 0;
+#endif
+
+    return ok;
+}
+
+static int output_rewrite(output_stream *out, unsigned int offset, const void *data, unsigned int size)
+{
+#ifdef _WIN32
+    if (fseek(out->f, offset, SEEK_SET)) return 0;
+    return (fwrite(data, 1, size, out->f) == size) ? 1 : 0;
 #else
-        free(mem);
+    return (pwrite(out->fd, data, size, offset) == (ssize_t)size) ? 1 : 0;
+#endif
+}
+
+static int output_close(output_stream *out)
+{
+    unsigned int index;
+    int ok;
+
+    ok = 1;
+    if (out->is_file)
+    {
+#ifdef _WIN32
+        if (fclose(out->f)) ok = 0;
+#else
+        if (close(out->fd)) ok = 0;
 #endif
-        fclose(f);
-        return NULL;
     }
 
-    if (length != NULL)
+    for (index = 0; index < OUTPUT_NUM_CHUNKS; index++)
     {
-        *length = datalen;
+        free(out->chunks[index]);
+        out->chunks[index] = NULL;
     }
 
-    return mem;
+    return ok;
 }
 
-static void usage(const char *progname)
+static int initialize_synth(void)
 {
-    static const char basename[] = "d77_pcmconvert";
+    int retval;
 
-    if (progname == NULL)
+    retval = d77r_initialize(renderer, &d77_settings);
+    switch (retval)
     {
-        progname = basename;
+        case 0:
+            break;
+        case D77R_ERROR_INIT_DATAFILE:
+            fprintf(stderr, "error initializing DATA file\n");
+            return retval;
+        case D77R_ERROR_INIT_SYNTH:
+            fprintf(stderr, "error initializing synth\n");
+            return retval;
+        default:
+            fprintf(stderr, "error allocating output buffer\n");
+            return retval;
     }
-    else
+
+    d77_settings = *d77r_get_settings(renderer);
+    frequency = d77r_get_frequency(renderer);
+    samples_per_call = d77r_get_samples_per_call(renderer);
+    bytes_per_call = samples_per_call * 2 * sizeof(int16_t);
+    output_buffer = d77r_get_output_buffer(renderer);
+
+    return 0;
+}
+
+static unsigned int get_end_call(uint64_t duration)
+{
+    // events are rendered up to 112 ms after the end of file (or up to the end of the range)
+    if ((arg_end != 0) && ((uint64_t)arg_end * 1000 < duration + 112000))
     {
-        const char *slash;
+        return d77r_get_total_calls(renderer, (uint64_t)arg_end * 1000);
+    }
 
-        slash = strrchr(progname, '/');
-        if (slash != NULL)
+    return d77r_get_total_calls(renderer, duration + 112000);
+}
+
+static INLINE void next_event(const midi_event_info **cur_event, unsigned int *remaining_events)
+{
+    int result;
+
+    if (input_stream == NULL)
+    {
+        (*cur_event)++;
+        (*remaining_events)--;
+        return;
+    }
+
+    // streamed events are read one at a time
+    result = midi_stream_next(input_stream, cur_event);
+    if (result < 0) stream_error = 1;
+    *remaining_events = (result > 0) ? 1 : 0;
+}
+
+static INLINE int is_note_event(const midi_event_info *event)
+{
+    // note off, note on, polyphonic key pressure
+    return (event->len <= MIDI_EVENT_SHORT_LEN) && (((event->msg.data[0] & 0xe0) == 0x80) || ((event->msg.data[0] & 0xf0) == 0xa0));
+}
+
+static unsigned int seek_events(uint64_t time, const midi_event_info **cur_event, unsigned int *remaining_events)
+{
+    const midi_seek_point *seek_points, *seek_point;
+    const uint32_t *messages;
+    unsigned int num_seek_points, low, high, middle, index;
+
+    // compiled MIDI files contain seek points with the state - restore the state from the last seek point before the time
+    num_seek_points = get_midi_seek_points(midi_events, &seek_points);
+
+    low = 0;
+    high = num_seek_points;
+    while (low < high)
+    {
+        middle = (low + high) / 2;
+        if (seek_points[middle].time <= time) low = middle + 1;
+        else high = middle;
+    }
+
+    if (low == 0) return 0;
+
+    seek_point = &(seek_points[low - 1]);
+    messages = (const uint32_t *)((const uint8_t *)seek_points + seek_point->messages_offset);
+
+    for (index = 0; index < seek_point->num_messages; index++)
+    {
+        if (messages[index] & MIDI_SEEK_EVENT)
         {
-            progname = slash + 1;
+            d77r_send_event(renderer, midi_events + (messages[index] & ~MIDI_SEEK_EVENT));
         }
-
-#ifdef _WIN32
-        slash = strrchr(progname, '\\');
-        if (slash != NULL)
+        else
         {
-            progname = slash + 1;
+            D77_MidiMessageShort(messages[index]);
         }
-#endif
     }
 
-    printf(
-        "%s - WebSynth D-77 pcm convert\n"
-        "Usage: %s [OPTIONS]...\n"
-        "  -i PATH  Input path (path to .mid)\n"
-        "  -s       Output raw data do stdout\n"
-        "  -o PATH  Output path (path to .wav)\n"
-        "  -w PATH  Datafile path (path to dsweb*.dat)\n"
-#ifdef INDIRECT_64BIT
-#ifdef _WIN32
-        "  -b PATH  Library path (path to d77_lib.dll)\n"
-#else
-        "  -b PATH  Library path (path to d77_lib.so)\n"
-#endif
-#endif
-        "  -f NUM   Frequency (22050/44100 Hz)\n"
-        "  -p NUM   Polyphony (8-256)\n"
-        "  -m NUM   Master volume (0-200)\n"
-        "  -r NUM   Reverb effect (0=off, 1=on)\n"
-        "  -c NUM   Chorus effect (0=off, 1=on)\n"
-        "  -l NUM   Cpu load (20-85)\n"
-        "  -h       Help\n"
-        "Advanced parameters:\n"
-        "  -aRevAdj NUM     (0-200)\n"
-        "  -aChoAdj NUM     (0-200)\n"
-        "  -aOutLev NUM     (0-200)\n"
-        "  -aRevFb NUM      (0-200)\n"
-        "  -aRevDrm NUM     (0-200)\n"
-        "  -aResoUpAdj NUM  (0-100)\n",
-        basename,
-        progname
-    );
-    exit(1);
+    // the following events are chased as usual
+    *cur_event = midi_events + seek_point->event_index;
+    *remaining_events = midi_events[0].len + 1 - seek_point->event_index;
+
+    return seek_point->num_messages;
 }
 
-int main(int argc, char *argv[])
+static int optimize_events(midi_event_info **original_ptr)
 {
-    int return_value;
+    int16_t value[16][130]; // current value of controllers, channel pressure (128) and pitch wheel (129), -1 = unknown
+    uint32_t pending[16][130]; // index of the last message, 0 = none
+    uint32_t barrier[16]; // index of the last event which must be sent after the pending messages on the channel
+    unsigned int num_events, num_dropped, index, call, window_first, channel, slot;
+    int new_value;
+    const uint8_t *data;
+    uint64_t call_time;
+    midi_event_info *new_events;
+    uint8_t *keep;
+    double start_time;
 
-    // default settings from .ini file
-    d77_settings.dwSamplingFreq = 44100;
-    d77_settings.dwPolyphony = 64;
-    d77_settings.dwCpuLoadL = 60;
-    d77_settings.dwCpuLoadH = 90;
-    d77_settings.dwRevSw = 1;
-    d77_settings.dwChoSw = 1;
-    d77_settings.dwMVol = 100;
-    d77_settings.dwRevAdj = 95;
-    d77_settings.dwChoAdj = 70;
-    d77_settings.dwOutLev = 110;
-    d77_settings.dwRevFb = 95;
-    d77_settings.dwRevDrm = 80;
-    d77_settings.dwResoUpAdj = 40;
-    d77_settings.dwCacheSize = 3;
-    d77_settings.dwTimeReso = 80;
+    // drops events which don't change the state seen by the render calls:
+    // controller, channel pressure and pitch wheel messages which set the current value,
+    // and the same messages overwritten before the next render call (unless a note or other message is between them)
+    // messages for RPN / NRPN (data entry, parameter numbers), pedals (sustain, sostenuto, hold 2), mode messages, program changes and sysex are kept in order
+    // (a pedal release between two pedal presses releases the held notes, so the pedal messages are never dropped)
+    start_time = get_time();
+    num_events = midi_events[0].len;
 
-    // parse arguments
-    if (argc > 1)
+    keep = (uint8_t *) malloc(num_events + 1);
+    if (keep == NULL) return 0;
+
+    memset(keep, 1, num_events + 1);
+    memset(value, 0xff, sizeof(value));
+    memset(pending, 0, sizeof(pending));
+    memset(barrier, 0, sizeof(barrier));
+
+    num_dropped = 0;
+    call = 1;
+    call_time = d77r_get_call_time(renderer, call);
+    window_first = 1;
+
+    for (index = 1; index <= num_events; index++)
     {
-        int i, j;
-        for (i = 1; i < argc; i++)
+        // events up to the call time are sent before the same render call
+        if (midi_events[index].time > call_time)
         {
-            if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+            do
             {
-                switch (argv[i][1])
-                {
-                    case 'i': // input
-                        if ((i + 1) < argc)
-                        {
-                            i++;
-                            arg_input = argv[i];
+                call++;
+                call_time = d77r_get_call_time(renderer, call);
+            } while (midi_events[index].time > call_time);
+
+            window_first = index;
+        }
+
+        data = MIDI_EVENT_DATA(midi_events + index);
+
+        if ((midi_events[index].len > 3) || ((data[0] & 0xf0) == 0xf0))
+        {
+            // meta events aren't sent to the synth
+            if (data[0] == 0xff)
+            {
+                keep[index] = 0;
+                num_dropped++;
+                continue;
+            }
+
+            // sysex can change any state
+            memset(value, 0xff, sizeof(value));
+            for (channel = 0; channel < 16; channel++) barrier[channel] = index;
+            continue;
+        }
+
+        channel = data[0] & 0x0f;
+
+        switch (data[0] >> 4)
+        {
+            case 0x0b: // controller
+                slot = data[1];
+                new_value = data[2];
+
+                if ((slot == 6) || (slot == 38) || (slot == 64) || (slot == 66) || (slot == 69) || (slot == 84) || ((slot >= 96) && (slot <= 101)) || (slot >= 120))
+                {
+                    if (slot == 121) memset(value[channel], 0xff, sizeof(value[channel])); // reset all controllers
+                    barrier[channel] = index;
+                    continue;
+                }
+
+                // controller MSB can reset the LSB, so the MSB isn't repeated after the LSB was set
+                if (slot < 32) value[channel][slot + 32] = -1;
+                else if (slot < 64) value[channel][slot - 32] = -1;
+                break;
+
+            case 0x0d: // channel pressure
+                slot = 128;
+                new_value = data[1];
+                break;
+
+            case 0x0e: // pitch wheel
+                slot = 129;
+                new_value = data[1] | (data[2] << 7);
+                break;
+
+            case 0x0c: // program change
+                memset(value[channel], 0xff, sizeof(value[channel]));
+                barrier[channel] = index;
+                continue;
+
+            default: // notes
+                barrier[channel] = index;
+                continue;
+        }
+
+        if (value[channel][slot] == new_value)
+        {
+            keep[index] = 0;
+            num_dropped++;
+            continue;
+        }
+
+        if ((pending[channel][slot] >= window_first) && (pending[channel][slot] > barrier[channel]))
+        {
+            keep[pending[channel][slot]] = 0;
+            num_dropped++;
+        }
+
+        value[channel][slot] = new_value;
+        pending[channel][slot] = index;
+    }
+
+    // the last event is kept (it's used for the end of tail)
+    for (index = num_events; index > 0; index--)
+    {
+        if (MIDI_EVENT_DATA(midi_events + index)[0] != 0xff)
+        {
+            if (!keep[index])
+            {
+                keep[index] = 1;
+                num_dropped--;
+            }
+            break;
+        }
+    }
+
+    if ((num_dropped != 0) && (num_dropped < num_events))
+    {
+        if (filter_midi_data(midi_events, keep, &new_events))
+        {
+            free(keep);
+            return 0;
+        }
+
+        // the original events are kept, if requested
+        if (original_ptr != NULL) *original_ptr = midi_events;
+        else free_midi_data(midi_events);
+        midi_events = new_events;
+    }
+    else
+    {
+        num_dropped = 0;
+    }
+
+    free(keep);
+
+    optimize_dropped = num_dropped;
+    optimize_time = get_time() - start_time;
+    return 1;
+}
+
+static uint64_t get_last_event_time(void)
+{
+    unsigned int index;
+    midi_event_info *event;
+
+    // time of the last event which is sent to the synth (meta events like End of Track are skipped)
+    for (index = midi_events[0].len; index > 0; index--)
+    {
+        event = midi_events + index;
+        if (MIDI_EVENT_DATA(event)[0] != 0xff) return event->time;
+    }
+
+    return 0;
+}
+
+static unsigned int get_peak_level(const int16_t *samples, unsigned int count)
+{
+    unsigned int index;
+    int value, peak;
+
+    // simple loop without early exit, so that the compiler can vectorize it
+    peak = 0;
+    for (index = 0; index < count; index++)
+    {
+        value = samples[index];
+        value = (value < 0) ? -value : value;
+        peak = (value > peak) ? value : peak;
+    }
+
+    return peak;
+}
+
+static unsigned int get_nonzero_length(const int16_t *samples, unsigned int count)
+{
+    // number of samples (rounded up to whole stereo frames) up to the last non-zero sample
+    while ((count > 0) && (samples[count - 1] == 0)) count--;
+
+    return (count + 1) & ~1;
+}
+
+#ifndef _WIN32
+static void *map_shared_memory(size_t size)
+{
+    void *mem;
+
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return (mem != MAP_FAILED) ? mem : NULL;
+}
+
+static uint64_t get_hash(uint64_t hash, const void *data, size_t size)
+{
+    size_t index;
+
+    // FNV-1a
+    for (index = 0; index < size; index++)
+    {
+        hash = (hash ^ ((const uint8_t *)data)[index]) * UINT64_C(0x100000001b3);
+    }
+
+    return hash;
+}
+
+static void update_output_hash(const void *data, unsigned int size)
+{
+    output_hash = get_hash(output_hash, data, size);
+}
+
+static int get_file_hash(const char *path, uint64_t *hash)
+{
+    uint8_t buffer[65536];
+    ssize_t read_bytes;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    *hash = UINT64_C(0xcbf29ce484222325);
+    while (1)
+    {
+        read_bytes = read(fd, buffer, sizeof(buffer));
+        if (read_bytes < 0)
+        {
+            if (errno == EINTR) continue;
+            close(fd);
+            return 0;
+        }
+        if (read_bytes == 0) break;
+
+        *hash = get_hash(*hash, buffer, read_bytes);
+    }
+
+    close(fd);
+    return 1;
+}
+
+#ifdef __linux__
+static int get_build_id_hash(const char *path, uint64_t *hash)
+{
+    union {
+        unsigned char ident[EI_NIDENT];
+        Elf32_Ehdr ehdr32;
+        Elf64_Ehdr ehdr64;
+    } header;
+    union {
+        Elf32_Phdr phdr32;
+        Elf64_Phdr phdr64;
+    } program;
+    Elf64_Nhdr note;
+    uint8_t notes[4096];
+    uint64_t phoff, offset, size;
+    unsigned int phnum, phentsize, index, pos, align;
+    int fd, is64, found;
+
+    // the build ID is set by the linker from the contents of the file (it's not in files linked without it)
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    found = 0;
+    memset(&header, 0, sizeof(header));
+    if ((pread(fd, &header, sizeof(header), 0) < (ssize_t)sizeof(Elf32_Ehdr)) || memcmp(header.ident, ELFMAG, SELFMAG)) goto build_id_done;
+
+    // only files with native byte order
+    is64 = (header.ident[EI_CLASS] == ELFCLASS64) ? 1 : 0;
+    if ((is64 ? header.ehdr64.e_version : header.ehdr32.e_version) != EV_CURRENT) goto build_id_done;
+
+    phoff = is64 ? header.ehdr64.e_phoff : header.ehdr32.e_phoff;
+    phnum = is64 ? header.ehdr64.e_phnum : header.ehdr32.e_phnum;
+    phentsize = is64 ? header.ehdr64.e_phentsize : header.ehdr32.e_phentsize;
+    if (phentsize < (is64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr))) goto build_id_done;
+
+    for (index = 0; (index < phnum) && !found; index++)
+    {
+        if (pread(fd, &program, is64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr), phoff + (uint64_t)index * phentsize) != (ssize_t)(is64 ? sizeof(Elf64_Phdr) : sizeof(Elf32_Phdr))) break;
+        if ((is64 ? program.phdr64.p_type : program.phdr32.p_type) != PT_NOTE) continue;
+
+        offset = is64 ? program.phdr64.p_offset : program.phdr32.p_offset;
+        size = is64 ? program.phdr64.p_filesz : program.phdr32.p_filesz;
+        align = ((is64 ? program.phdr64.p_align : program.phdr32.p_align) == 8) ? 8 : 4;
+        if (size > sizeof(notes)) size = sizeof(notes);
+        if (pread(fd, notes, size, offset) != (ssize_t)size) break;
+
+        // note header (same in 32-bit and 64-bit files), name, descriptor
+        for (pos = 0; pos + sizeof(note) <= size; )
+        {
+            memcpy(&note, notes + pos, sizeof(note));
+            pos += sizeof(note);
+            if ((note.n_namesz > size - pos) || (((note.n_namesz + align - 1) & ~(align - 1)) + (uint64_t)note.n_descsz > size - pos)) break;
+
+            if ((note.n_type == NT_GNU_BUILD_ID) && (note.n_namesz == 4) && (0 == memcmp(notes + pos, "GNU", 4)))
+            {
+                pos += (note.n_namesz + align - 1) & ~(align - 1);
+                *hash = get_hash(UINT64_C(0xcbf29ce484222325), notes + pos, note.n_descsz);
+                found = 1;
+                break;
+            }
+
+            pos += ((note.n_namesz + align - 1) & ~(align - 1)) + ((note.n_descsz + align - 1) & ~(align - 1));
+        }
+    }
+
+build_id_done:
+    close(fd);
+    return found;
+}
+#endif
+
+static int get_library_hash(const char *path, uint64_t *hash)
+{
+    char hash_path[4096], temp_path[4096];
+    struct stat statbuf;
+    unsigned long long size, mtime, inode, value;
+    FILE *f;
+
+#ifdef __linux__
+    if (get_build_id_hash(path, hash)) return 1;
+#endif
+
+    // without build ID the whole file is hashed - the hash is stored in the cache directory,
+    // so that it's computed again only when the file changes (size, modification time, inode)
+    if (stat(path, &statbuf)) return 0;
+
+    snprintf(hash_path, sizeof(hash_path), "%s/.hash.%016llx", cache_dir, (unsigned long long)get_hash(UINT64_C(0xcbf29ce484222325), path, strlen(path)));
+
+    f = fopen(hash_path, "r");
+    if (f != NULL)
+    {
+        if ((fscanf(f, "%llu %llu %llu %llx", &size, &mtime, &inode, &value) == 4) &&
+            (size == (unsigned long long)statbuf.st_size) &&
+            (mtime == (unsigned long long)statbuf.st_mtime) &&
+            (inode == (unsigned long long)statbuf.st_ino)
+           )
+        {
+            fclose(f);
+            *hash = value;
+            return 1;
+        }
+        fclose(f);
+    }
+
+    if (!get_file_hash(path, hash)) return 0;
+
+    snprintf(temp_path, sizeof(temp_path), "%s/.tmp.%i.hash", cache_dir, (int)getpid());
+    f = fopen(temp_path, "w");
+    if (f != NULL)
+    {
+        fprintf(f, "%llu %llu %llu %016llx\n", (unsigned long long)statbuf.st_size, (unsigned long long)statbuf.st_mtime, (unsigned long long)statbuf.st_ino, (unsigned long long)*hash);
+        if (fclose(f) || rename(temp_path, hash_path)) unlink(temp_path);
+    }
+
+    return 1;
+}
+
+static const char *get_executable_path(void)
+{
+#ifdef __APPLE__
+    static char path[4096];
+    uint32_t size = sizeof(path);
+
+    return (_NSGetExecutablePath(path, &size) == 0) ? path : NULL;
+#else
+    // procfs (Linux)
+    return "/proc/self/exe";
+#endif
+}
+
+static uint64_t get_cache_key(void)
+{
+    static const char cache_version[] = "d77_pcmconvert cache 4";
+    uint32_t options[7];
+    unsigned int index;
+    midi_event_info *event;
+    uint64_t key;
+
+    key = get_hash(UINT64_C(0xcbf29ce484222325), cache_version, sizeof(cache_version));
+    key = get_hash(key, &datafile_hash, sizeof(datafile_hash));
+    key = get_hash(key, &library_hash, sizeof(library_hash));
+    key = get_hash(key, &d77_settings, sizeof(d77_settings));
+
+    // options which change the output
+    memset(options, 0, sizeof(options));
+    options[0] = arg_start;
+    options[1] = arg_end;
+    options[2] = (arg_start != 0) ? arg_preroll : 0;
+    if (tail_mode)
+    {
+        options[3] = 1;
+        options[4] = arg_tail_window;
+        options[5] = arg_tail_threshold;
+        options[6] = arg_tail_max;
+    }
+    key = get_hash(key, options, sizeof(options));
+
+    // event stream (times and data)
+    for (index = 1; index <= midi_events[0].len; index++)
+    {
+        event = midi_events + index;
+        key = get_hash(key, &event->time, sizeof(event->time));
+        key = get_hash(key, &event->len, sizeof(event->len));
+        key = get_hash(key, MIDI_EVENT_DATA(event), event->len);
+    }
+
+    return key;
+}
+
+static void get_cache_path(char *path, size_t size, uint64_t key)
+{
+    snprintf(path, size, "%s/%016llx.wav", cache_dir, (unsigned long long)key);
+}
+
+static int copy_file_data(int src_fd, int dst_fd, uint64_t size)
+{
+    uint8_t buffer[65536];
+    ssize_t read_bytes;
+
+#ifdef __linux__
+#ifdef FICLONE
+    // reflink (copy-on-write clone) on filesystems which support it
+    if ((size != 0) && (ioctl(dst_fd, FICLONE, src_fd) == 0)) return 1;
+#endif
+
+    // copy in kernel
+    while (size != 0)
+    {
+        read_bytes = sendfile(dst_fd, src_fd, NULL, (size < 0x40000000) ? size : 0x40000000);
+        if (read_bytes < 0)
+        {
+            if (errno == EINTR) continue;
+            if ((errno == EINVAL) || (errno == ENOSYS)) break;
+            return 0;
+        }
+        if (read_bytes == 0) return 0;
+
+        size -= read_bytes;
+    }
+#endif
+
+    while (size != 0)
+    {
+        read_bytes = read(src_fd, buffer, (size < sizeof(buffer)) ? size : sizeof(buffer));
+        if (read_bytes < 0)
+        {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        if (read_bytes == 0) return 0;
+
+        if (write(dst_fd, buffer, read_bytes) != read_bytes) return 0;
+
+        size -= read_bytes;
+    }
+
+    return 1;
+}
+
+static int fetch_from_cache(uint64_t key, const char *output_path)
+{
+    char cache_path[4096];
+    struct stat statbuf;
+    int cache_fd, out_fd, ok;
+
+    get_cache_path(cache_path, sizeof(cache_path), key);
+
+    cache_fd = open(cache_path, O_RDONLY);
+    if (cache_fd < 0) return 0;
+
+    if (fstat(cache_fd, &statbuf))
+    {
+        close(cache_fd);
+        return 0;
+    }
+
+    // mark entry as recently used
+    futimens(cache_fd, NULL);
+
+    unlink(output_path);
+
+    // hardlink shares the (read-only) cache entry with the output file
+    if (cache_hardlink && (link(cache_path, output_path) == 0))
+    {
+        close(cache_fd);
+        return 1;
+    }
+
+    out_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out_fd < 0)
+    {
+        close(cache_fd);
+        return 0;
+    }
+
+    ok = copy_file_data(cache_fd, out_fd, statbuf.st_size);
+    if (close(out_fd)) ok = 0;
+    if (!ok) unlink(output_path);
+
+    close(cache_fd);
+    return ok;
+}
+
+typedef struct {
+    char *name;
+    uint64_t size;
+    time_t mtime;
+} cache_entry;
+
+static int compare_cache_entries(const void *a, const void *b)
+{
+    // least recently used first
+    return (((const cache_entry *)a)->mtime > ((const cache_entry *)b)->mtime) - (((const cache_entry *)a)->mtime < ((const cache_entry *)b)->mtime);
+}
+
+static void evict_cache_entries(void)
+{
+    DIR *dir;
+    struct dirent *dirent;
+    struct stat statbuf;
+    cache_entry *entries, *new_entries;
+    unsigned int num_entries, index;
+    uint64_t total_size;
+    char path[4096];
+
+    dir = opendir(cache_dir);
+    if (dir == NULL) return;
+
+    entries = NULL;
+    num_entries = 0;
+    total_size = 0;
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        if (dirent->d_name[0] == '.') continue;
+
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, dirent->d_name);
+        if (stat(path, &statbuf) || !S_ISREG(statbuf.st_mode)) continue;
+
+        if ((num_entries & 255) == 0)
+        {
+            new_entries = (cache_entry *)realloc(entries, (num_entries + 256) * sizeof(cache_entry));
+            if (new_entries == NULL) break;
+            entries = new_entries;
+        }
+
+        entries[num_entries].name = strdup(dirent->d_name);
+        if (entries[num_entries].name == NULL) break;
+        entries[num_entries].size = statbuf.st_size;
+        entries[num_entries].mtime = statbuf.st_mtime;
+        total_size += statbuf.st_size;
+        num_entries++;
+    }
+
+    closedir(dir);
+
+    if (total_size > cache_size)
+    {
+        qsort(entries, num_entries, sizeof(cache_entry), compare_cache_entries);
+
+        for (index = 0; (index < num_entries) && (total_size > cache_size); index++)
+        {
+            snprintf(path, sizeof(path), "%s/%s", cache_dir, entries[index].name);
+            if ((unlink(path) == 0) || (errno == ENOENT))
+            {
+                total_size -= entries[index].size;
+            }
+        }
+    }
+
+    for (index = 0; index < num_entries; index++)
+    {
+        free(entries[index].name);
+    }
+    free(entries);
+}
+
+static void store_to_cache(uint64_t key, const char *output_path)
+{
+    char cache_path[4096], temp_path[4096];
+    struct stat statbuf;
+    int out_fd, cache_fd, ok;
+
+    out_fd = open(output_path, O_RDONLY);
+    if (out_fd < 0) return;
+
+    if (fstat(out_fd, &statbuf) || ((uint64_t)statbuf.st_size > cache_size))
+    {
+        close(out_fd);
+        return;
+    }
+
+    get_cache_path(cache_path, sizeof(cache_path), key);
+    snprintf(temp_path, sizeof(temp_path), "%s/.tmp.%i.%016llx", cache_dir, (int)getpid(), (unsigned long long)key);
+
+    // cache entries are read-only, so that hardlinked outputs can't modify them
+    cache_fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0444);
+    if (cache_fd < 0)
+    {
+        close(out_fd);
+        return;
+    }
+
+    ok = copy_file_data(out_fd, cache_fd, statbuf.st_size);
+    if (close(cache_fd)) ok = 0;
+    close(out_fd);
+
+    // rename is atomic, concurrent readers see either no entry or the whole entry
+    if (!ok || rename(temp_path, cache_path))
+    {
+        unlink(temp_path);
+        return;
+    }
+
+    evict_cache_entries();
+}
+#endif
+
+static int render_file(const char *input_path, const char *output_path)
+{
+    int return_value;
+    unsigned int num_calls, remaining_events, first_call, start_call, end_call, num_chased;
+    unsigned int tail_min_call, tail_window_calls, last_loud_call, pending_zeros, written_length, length;
+    const midi_event_info *cur_event;
+    output_stream file_output, *out;
+    double start_time, first_sample_time;
+    uint64_t next_time, last_event_time;
+    int stream_input;
+    static const int16_t zero_samples[512];
+#ifndef _WIN32
+    struct {
+        uint64_t hash;
+        int result;
+        double time;
+    } *reference;
+    pid_t reference_pid;
+    uint64_t cache_key;
+    midi_event_info *original_events;
+#endif
+
+    // standard input can be read only once, so it's loaded in advance (the reference render uses the same events)
+    if ((midi_events == NULL) && (strcmp(input_path, "-") == 0) && load_midi_file(input_path, &timediv, &midi_events))
+    {
+        fprintf(stderr, "error loading MIDI file\n");
+        return 4;
+    }
+
+    start_time = get_time();
+    first_sample_time = 0;
+
+    // events are streamed from the file while rendering, unless all events are needed in advance (cache key, last event time, reference render)
+#ifndef _WIN32
+    stream_input = (midi_events == NULL) && ((cache_dir == NULL) || (output_path == NULL)) && !tail_mode && !optimize_mode;
+#else
+    stream_input = (midi_events == NULL) && !tail_mode && !optimize_mode;
+#endif
+
+    if (stream_input)
+    {
+        int open_result;
+
+        stream_error = 0;
+        open_result = midi_stream_open(input_path, &timediv, &input_stream);
+        if (open_result == MIDI_LOADER_COMPILED)
+        {
+            // compiled MIDI file is used directly, it's not streamed
+            stream_input = 0;
+        }
+        else if (open_result)
+        {
+            fprintf(stderr, "error loading MIDI file\n");
+            return 4;
+        }
+        // the first event
+        else if (midi_stream_next(input_stream, &cur_event) <= 0)
+        {
+            midi_stream_close(input_stream);
+            input_stream = NULL;
+            fprintf(stderr, "error loading MIDI file\n");
+            return 4;
+        }
+    }
+
+    // load MIDI file (unless it's already loaded)
+    if (!stream_input && (midi_events == NULL) && load_midi_file(input_path, &timediv, &midi_events))
+    {
+        fprintf(stderr, "error loading MIDI file\n");
+        return 4;
+    }
+
+#ifndef _WIN32
+    // the events without optimizing are kept for the reference render
+    original_events = NULL;
+    if (optimize_mode && !optimize_events(validate_mode ? &original_events : NULL))
+#else
+    if (optimize_mode && !optimize_events(NULL))
+#endif
+    {
+        free_midi_data(midi_events);
+        midi_events = NULL;
+        fprintf(stderr, "error allocating memory\n");
+        return 7;
+    }
+
+#ifndef _WIN32
+    // serve the output from cache if it was already rendered with the same events, settings, datafile and library
+    // (output to stdout is not cached - it can't be read back to store it)
+    cache_key = 0;
+    if ((cache_dir != NULL) && (output_path != NULL))
+    {
+        cache_key = get_cache_key();
+        if (fetch_from_cache(cache_key, output_path))
+        {
+            if (print_stats)
+            {
+                fprintf(stderr, "cache hit: %016llx, time: %.3f s\n", (unsigned long long)cache_key, get_time() - start_time);
+            }
+
+            free_midi_data(original_events);
+            free_midi_data(midi_events);
+            midi_events = NULL;
+            return 0;
+        }
+    }
+
+    // with --validate, the output of optimized events is compared with the render of the original events (in parallel)
+    reference = NULL;
+    reference_pid = 0;
+    if (optimize_mode && validate_mode)
+    {
+        reference = map_shared_memory(sizeof(*reference));
+        if (reference == NULL)
+        {
+            free_midi_data(original_events);
+            free_midi_data(midi_events);
+            midi_events = NULL;
+            fprintf(stderr, "error allocating memory\n");
+            return 7;
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+        reference->result = 12;
+        reference_pid = fork();
+        if (reference_pid == 0)
+        {
+            int fd;
+
+            // the events are already loaded
+            optimize_mode = 0;
+            print_stats = 0;
+            cache_dir = NULL;
+            hash_output = 1;
+            output_hash = UINT64_C(0xcbf29ce484222325);
+            if (original_events != NULL)
+            {
+                free_midi_data(midi_events);
+                midi_events = original_events;
+            }
+
+            // raw output to /dev/null
+            fd = open("/dev/null", O_WRONLY);
+            if ((fd < 0) || (dup2(fd, STDOUT_FILENO) < 0)) _exit(8);
+
+            start_time = get_time();
+            reference->result = render_file(input_path, NULL);
+            reference->time = get_time() - start_time;
+            reference->hash = output_hash;
+            _exit(0);
+        }
+
+        if (reference_pid < 0)
+        {
+            munmap(reference, sizeof(*reference));
+            free_midi_data(original_events);
+            free_midi_data(midi_events);
+            midi_events = NULL;
+            fprintf(stderr, "error rendering reference\n");
+            return 10;
+        }
+
+        hash_output = 1;
+        output_hash = UINT64_C(0xcbf29ce484222325);
+    }
+
+    // the original events are used only by the reference process
+    free_midi_data(original_events);
+#endif
+
+
+    return_value = 0;
+
+    // rendered range (in calls) - when streaming, the end is known after the last event is read
+    if (stream_input)
+    {
+        end_call = (arg_end != 0) ? d77r_get_total_calls(renderer, (uint64_t)arg_end * 1000) : UINT_MAX;
+    }
+    else
+    {
+        end_call = get_end_call(midi_events[0].time);
+    }
+    start_call = (unsigned int)(((uint64_t)arg_start * frequency) / (1000 * (uint64_t)samples_per_call));
+    if (start_call > end_call) start_call = end_call;
+
+    // tail mode: render from the last event until the output stays quiet for the tail window
+    last_event_time = 0;
+    tail_min_call = 0;
+    tail_window_calls = 0;
+    if (tail_mode)
+    {
+        last_event_time = get_last_event_time();
+        tail_min_call = d77r_get_total_calls(renderer, last_event_time);
+        tail_window_calls = (unsigned int)(((uint64_t)arg_tail_window * frequency + 1000 * (uint64_t)samples_per_call - 1) / (1000 * (uint64_t)samples_per_call));
+        end_call = d77r_get_total_calls(renderer, last_event_time + (uint64_t)arg_tail_max * 1000);
+        if ((arg_end != 0) && ((uint64_t)arg_end * 1000 < last_event_time + (uint64_t)arg_tail_max * 1000))
+        {
+            end_call = d77r_get_total_calls(renderer, (uint64_t)arg_end * 1000);
+        }
+        if (start_call > end_call) start_call = end_call;
+    }
+
+    first_call = start_call;
+    if (start_call != 0)
+    {
+        unsigned int preroll_calls;
+
+        preroll_calls = (unsigned int)(((uint64_t)arg_preroll * frequency + 1000 * (uint64_t)samples_per_call - 1) / (1000 * (uint64_t)samples_per_call));
+        first_call = (start_call > preroll_calls) ? start_call - preroll_calls : 0;
+    }
+
+    // play midi
+#ifndef _WIN32
+    // in playlist the output is shared by all files
+    out = (playlist_output != NULL) ? playlist_output : &file_output;
+    if ((playlist_output == NULL) && !output_open(out, output_path))
+#else
+    out = &file_output;
+    if (!output_open(out, output_path))
+#endif
+    {
+        free_midi_data(midi_events);
+        midi_events = NULL;
+        midi_stream_close(input_stream);
+        input_stream = NULL;
+        fprintf(stderr, "error opening output file\n");
+        return 8;
+    }
+
+#ifndef _WIN32
+    if ((output_path != NULL) && (playlist_output == NULL))
+#else
+    if (output_path != NULL)
+#endif
+    {
+        uint8_t wav_header[44];
+
+        // wav header - lengths are filled later
+        d77r_write_wav_header(wav_header, frequency, 0);
+
+        if (!output_write(out, wav_header, 44))
+        {
+            output_flush(out);
+            output_close(out);
+            free_midi_data(midi_events);
+            midi_events = NULL;
+            midi_stream_close(input_stream);
+            input_stream = NULL;
+            fprintf(stderr, "error writing to output file\n");
+            return 9;
+        }
+    }
+
+    num_calls = first_call;
+    if (stream_input)
+    {
+        // the first event was already read
+        remaining_events = 1;
+    }
+    else
+    {
+        remaining_events = midi_events[0].len;
+        cur_event = midi_events + 1;
+    }
+    last_loud_call = 0;
+    pending_zeros = 0;
+    written_length = 0;
+
+    // fast forward: chase the state (programs, controllers, sysex, ...) up to the pre-roll, without notes
+    num_chased = 0;
+    if (first_call != 0)
+    {
+        next_time = d77r_get_call_time(renderer, first_call);
+        if (!stream_input) num_chased = seek_events(next_time, &cur_event, &remaining_events);
+
+        while ((remaining_events > 0) && (cur_event->time <= next_time))
+        {
+            if (!is_note_event(cur_event))
+            {
+                d77r_send_event(renderer, cur_event);
+                num_chased++;
+            }
+
+            next_event(&cur_event, &remaining_events);
+        }
+    }
+
+    while (num_calls < end_call)
+    {
+        if (stream_input && (remaining_events == 0))
+        {
+            if (stream_error)
+            {
+                fprintf(stderr, "error reading MIDI file\n");
+                return_value = 4;
+                break;
+            }
+
+            // end of stream - the rest is rendered as with the whole file loaded
+            end_call = get_end_call(midi_stream_get_duration(input_stream));
+            stream_input = 0;
+            if (num_calls >= end_call) break;
+        }
+
+        num_calls++;
+
+        next_time = d77r_get_call_time(renderer, num_calls);
+        while ((remaining_events > 0) && (cur_event->time <= next_time))
+        {
+            d77r_send_event(renderer, cur_event);
+
+            next_event(&cur_event, &remaining_events);
+        }
+
+        if (!D77_RenderSamples(output_buffer))
+        {
+            fprintf(stderr, "error rendering samples\n");
+            return_value = 10;
+            break;
+        }
+
+        // pre-roll is not written
+        if (num_calls <= start_call) continue;
+
+        if (num_calls == start_call + 1)
+        {
+            first_sample_time = get_time();
+        }
+
+        if (tail_mode)
+        {
+            if (get_peak_level(output_buffer, bytes_per_call / sizeof(int16_t)) > arg_tail_threshold)
+            {
+                last_loud_call = num_calls;
+            }
+            else if ((num_calls >= tail_min_call) && (num_calls - ((last_loud_call > tail_min_call) ? last_loud_call : tail_min_call) >= tail_window_calls))
+            {
+                // quiet for the whole window - end of the tail
+                break;
+            }
+
+            // trailing digital silence is trimmed - zero samples are written only when followed by non-zero samples
+            length = get_nonzero_length(output_buffer, bytes_per_call / sizeof(int16_t));
+            if (length == 0)
+            {
+                pending_zeros += bytes_per_call / sizeof(int16_t);
+                continue;
+            }
+
+            while (pending_zeros != 0)
+            {
+                unsigned int count;
+
+                count = (pending_zeros < 512) ? pending_zeros : 512;
+                if (!output_write(out, zero_samples, count * sizeof(int16_t)))
+                {
+                    break;
+                }
+#ifndef _WIN32
+                if (hash_output) update_output_hash(zero_samples, count * sizeof(int16_t));
+#endif
+                pending_zeros -= count;
+                written_length += count * sizeof(int16_t);
+            }
+            if (pending_zeros != 0)
+            {
+                fprintf(stderr, "error writing to output file\n");
+                return_value = 9;
+                break;
+            }
+
+            pending_zeros = bytes_per_call / sizeof(int16_t) - length;
+        }
+        else
+        {
+            length = bytes_per_call / sizeof(int16_t);
+        }
+
+#ifdef BIG_ENDIAN_BYTE_ORDER
+        // swap values to little-endian
+        {
+            int i;
+            for (i = 0; i < bytes_per_call; i += 2)
+            {
+                uint8_t value;
+                value = output_buffer[i];
+                output_buffer[i] = output_buffer[i + 1];
+                output_buffer[i + 1] = value;
+            }
+        }
+#endif
+
+        if (!output_write(out, output_buffer, length * sizeof(int16_t)))
+        {
+            fprintf(stderr, "error writing to output file\n");
+            return_value = 9;
+            break;
+        }
+#ifndef _WIN32
+        if (hash_output) update_output_hash(output_buffer, length * sizeof(int16_t));
+#endif
+        written_length += length * sizeof(int16_t);
+    }
+
+#ifndef _WIN32
+    playlist_length += written_length;
+
+    // the shared output of playlist is finished after the last file
+    if (playlist_output == NULL)
+#endif
+    {
+        if (!output_flush(out) && (return_value == 0))
+        {
+            fprintf(stderr, "error writing to output file\n");
+            return_value = 9;
+        }
+
+        if ((output_path != NULL) && (return_value == 0))
+        {
+            uint8_t chunk_length[4];
+
+            // RIFF length
+            WRITE_LE_UINT32(chunk_length, 36 + written_length);
+            if (!output_rewrite(out, 4, chunk_length, 4))
+            {
+                fprintf(stderr, "error writing to output file\n");
+                return_value = 9;
+            }
+
+            // data chunk length
+            WRITE_LE_UINT32(chunk_length, written_length);
+            if (!output_rewrite(out, 40, chunk_length, 4))
+            {
+                fprintf(stderr, "error writing to output file\n");
+                return_value = 9;
+            }
+        }
+
+        if (!output_close(out) && (return_value == 0))
+        {
+            fprintf(stderr, "error writing to output file\n");
+            return_value = 9;
+        }
+    }
+
+    if (print_stats && (return_value == 0))
+    {
+        double render_time, audio_time;
+
+        render_time = get_time() - start_time;
+        audio_time = (written_length / (2 * sizeof(int16_t))) / (double)frequency;
+        fprintf(stderr, "audio: %.3f s (%.3f s - %.3f s), render time: %.3f s (%.1fx realtime)\n", audio_time, (start_call * (uint64_t)samples_per_call) / (double)frequency, (start_call * (uint64_t)samples_per_call) / (double)frequency + audio_time, render_time, (render_time > 0) ? audio_time / render_time : 0.0);
+        if (optimize_mode)
+        {
+            fprintf(stderr, "optimize: %u of %u events dropped (%.1f%%), time: %.3f s\n", optimize_dropped, midi_events[0].len + optimize_dropped, optimize_dropped * 100.0 / (midi_events[0].len + optimize_dropped), optimize_time);
+        }
+        if (start_call != 0)
+        {
+            fprintf(stderr, "time to first sample: %.3f s (%u events chased, %u pre-roll calls)\n", (start_call < end_call) ? first_sample_time - start_time : 0.0, num_chased, start_call - first_call);
+        }
+        if (tail_mode)
+        {
+            fprintf(stderr, "tail: last event at %.3f s, %u calls rendered after it, %.3f s of trailing silence trimmed\n", last_event_time / 1000000.0, (num_calls > tail_min_call) ? num_calls - tail_min_call : 0, (pending_zeros / 2) / (double)frequency);
+        }
+    }
+
+#ifndef _WIN32
+    if (reference != NULL)
+    {
+        int status;
+
+        hash_output = 0;
+        if ((waitpid(reference_pid, &status, 0) != reference_pid) || (reference->result != 0))
+        {
+            if (return_value == 0)
+            {
+                fprintf(stderr, "error rendering reference\n");
+                return_value = 10;
+            }
+        }
+        else if (return_value == 0)
+        {
+            double render_time;
+
+            render_time = get_time() - start_time;
+            fprintf(stderr, "optimize: %.3f s, without optimizing: %.3f s (%.2fx), output %s\n", render_time, reference->time, (render_time > 0) ? reference->time / render_time : 0.0, (reference->hash == output_hash) ? "identical" : "DIFFERENT");
+
+            // output of the optimized events is different
+            if (reference->hash != output_hash) return_value = 13;
+        }
+
+        munmap(reference, sizeof(*reference));
+    }
+
+    // output to stdout is not stored in cache
+    if ((cache_dir != NULL) && (output_path != NULL) && (return_value == 0))
+    {
+        store_to_cache(cache_key, output_path);
+        if (print_stats)
+        {
+            fprintf(stderr, "cache miss: %016llx\n", (unsigned long long)cache_key);
+        }
+    }
+#endif
+
+    free_midi_data(midi_events);
+    midi_events = NULL;
+    midi_stream_close(input_stream);
+    input_stream = NULL;
+
+    return return_value;
+}
+
+#ifndef _WIN32
+static int add_batch_input(const char *path)
+{
+    const char **new_inputs;
+
+    if ((num_batch_inputs & 255) == 0)
+    {
+        new_inputs = (const char **)realloc(batch_inputs, (num_batch_inputs + 256) * sizeof(const char *));
+        if (new_inputs == NULL) return 0;
+        batch_inputs = new_inputs;
+    }
+
+    batch_inputs[num_batch_inputs] = path;
+    num_batch_inputs++;
+    return 1;
+}
+
+static int read_batch_list(const char *listpath)
+{
+    FILE *f;
+    char line[4096], *path;
+    size_t len;
+
+    if (strcmp(listpath, "-") == 0)
+    {
+        f = stdin;
+    }
+    else
+    {
+        f = fopen(listpath, "rt");
+        if (f == NULL) return 0;
+    }
+
+    // one input path per line, empty lines and lines starting with # are skipped
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        len = strlen(line);
+        while ((len != 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r'))) len--;
+        line[len] = 0;
+
+        if ((len == 0) || (line[0] == '#')) continue;
+
+        path = strdup(line);
+        if ((path == NULL) || !add_batch_input(path))
+        {
+            free(path);
+            if (f != stdin) fclose(f);
+            return 0;
+        }
+    }
+
+    if (f != stdin) fclose(f);
+    return 1;
+}
+
+static char *get_output_path(const char *input_path)
+{
+    const char *name, *extension, *template_pos;
+    size_t name_len;
+    char *output_path;
+
+    name = strrchr(input_path, '/');
+    name = (name != NULL) ? name + 1 : input_path;
+    extension = strrchr(name, '.');
+    name_len = ((extension != NULL) && (extension != name)) ? (size_t)(extension - name) : strlen(name);
+
+    template_pos = strstr(arg_outdir, "%s");
+    if (template_pos != NULL)
+    {
+        // output path template - %s is replaced by the input file name without extension
+        output_path = (char *)malloc(strlen(arg_outdir) - 2 + name_len + 1);
+        if (output_path == NULL) return NULL;
+
+        memcpy(output_path, arg_outdir, template_pos - arg_outdir);
+        memcpy(output_path + (template_pos - arg_outdir), name, name_len);
+        strcpy(output_path + (template_pos - arg_outdir) + name_len, template_pos + 2);
+    }
+    else
+    {
+        // output directory
+        output_path = (char *)malloc(strlen(arg_outdir) + 1 + name_len + 5);
+        if (output_path == NULL) return NULL;
+
+        sprintf(output_path, "%s/%.*s.wav", arg_outdir, (int)name_len, name);
+    }
+
+    return output_path;
+}
+
+static int compare_batch_jobs(const void *a, const void *b)
+{
+    const batch_job *job_a = (const batch_job *)a;
+    const batch_job *job_b = (const batch_job *)b;
+
+    // largest (longest) jobs first, otherwise keep the input order
+    if (job_a->input_size != job_b->input_size) return (job_a->input_size > job_b->input_size) ? -1 : 1;
+    return (job_a->index < job_b->index) ? -1 : ((job_a->index > job_b->index) ? 1 : 0);
+}
+
+static int compare_batch_outputs(const void *a, const void *b)
+{
+    const batch_job *job_a = (const batch_job *)a;
+    const batch_job *job_b = (const batch_job *)b;
+    int result;
+
+    // jobs without output path first
+    if ((job_a->output_path == NULL) || (job_b->output_path == NULL)) return (job_a->output_path != NULL) - (job_b->output_path != NULL);
+
+    result = strcmp(job_a->output_path, job_b->output_path);
+    if (result != 0) return result;
+    return (job_a->index < job_b->index) ? -1 : ((job_a->index > job_b->index) ? 1 : 0);
+}
+
+static int convert_batch(void)
+{
+    batch_job *jobs, *job;
+    struct stat st;
+    unsigned int num_jobs, next_job, num_running, num_done, num_failed, num_workers, index;
+    double start_time, total_wall, total_cpu, total_audio;
+    struct rusage usage;
+    pid_t pid;
+    int status;
+
+    num_failed = 0;
+    if ((arg_list != NULL) && !read_batch_list(arg_list))
+    {
+        fprintf(stderr, "error reading input list\n");
+        return 11;
+    }
+
+    num_jobs = num_batch_inputs;
+    if (num_jobs == 0)
+    {
+        fprintf(stderr, "no input file\n");
+        return 11;
+    }
+
+    jobs = (batch_job *)calloc(num_jobs, sizeof(batch_job));
+    if (jobs == NULL)
+    {
+        fprintf(stderr, "error allocating memory\n");
+        return 11;
+    }
+
+    num_workers = arg_jobs;
+    if (num_workers == 0)
+    {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_cpus > 0) ? num_cpus : 1;
+    }
+
+    // the MIDI files are parsed by the workers, the size of the file is used to estimate the duration of the job
+    for (index = 0; index < num_jobs; index++)
+    {
+        job = &(jobs[index]);
+        job->index = index;
+        job->input_path = batch_inputs[index];
+        job->output_path = get_output_path(job->input_path);
+        job->result = -1;
+
+        if (job->output_path == NULL)
+        {
+            job->result = 11;
+        }
+        else if (stat(job->input_path, &st) < 0)
+        {
+            job->result = 4;
+        }
+        else
+        {
+            job->input_size = st.st_size;
+        }
+    }
+
+    // input files with the same name (in different directories) would be written to the same output file
+    qsort(jobs, num_jobs, sizeof(batch_job), compare_batch_outputs);
+    for (index = 1; index < num_jobs; index++)
+    {
+        if ((jobs[index - 1].output_path != NULL) && (strcmp(jobs[index - 1].output_path, jobs[index].output_path) == 0))
+        {
+            fprintf(stderr, "output path collision: %s and %s -> %s\n", jobs[index - 1].input_path, jobs[index].input_path, jobs[index].output_path);
+            num_failed = 1;
+        }
+    }
+
+    if (num_failed)
+    {
+        for (index = 0; index < num_jobs; index++)
+        {
+            free(jobs[index].output_path);
+        }
+        free(jobs);
+        return 11;
+    }
+
+    qsort(jobs, num_jobs, sizeof(batch_job), compare_batch_jobs);
+
+    // each job is rendered in a child process forked from the initialized synth (copy-on-write)
+    start_time = get_time();
+    total_cpu = total_audio = 0;
+    num_failed = num_done = num_running = next_job = 0;
+    while (num_done < num_jobs)
+    {
+        while ((num_running < num_workers) && (next_job < num_jobs))
+        {
+            job = &(jobs[next_job]);
+            next_job++;
+
+            if (job->result >= 0)
+            {
+                // job failed before rendering
+                num_done++;
+                num_failed++;
+                printf("[%u/%u] %s: error %i\n", num_done, num_jobs, job->input_path, job->result);
+                continue;
+            }
+
+            fflush(stdout);
+            fflush(stderr);
+
+            job->start_time = get_time();
+            pid = fork();
+            if (pid == 0)
+            {
+                status = render_file(job->input_path, job->output_path);
+                fflush(NULL);
+                _exit(status);
+            }
+
+            if (pid < 0)
+            {
+                num_done++;
+                num_failed++;
+                job->result = 11;
+                printf("[%u/%u] %s: error forking process\n", num_done, num_jobs, job->input_path);
+                continue;
+            }
+
+            job->pid = pid;
+            num_running++;
+        }
+
+        if (num_running == 0) continue;
+
+        pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0) break;
+
+        for (index = 0; index < num_jobs; index++)
+        {
+            if (jobs[index].pid == pid) break;
+        }
+        if (index >= num_jobs) continue;
+
+        job = &(jobs[index]);
+        job->pid = 0;
+        job->wall_time = get_time() - job->start_time;
+        job->cpu_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+        job->result = WIFEXITED(status) ? WEXITSTATUS(status) : 12;
+        num_running--;
+        num_done++;
+
+        total_cpu += job->cpu_time;
+
+        if (job->result)
+        {
+            num_failed++;
+            printf("[%u/%u] %s: error %i\n", num_done, num_jobs, job->input_path, job->result);
+        }
+        else
+        {
+            // duration of the rendered audio (from the size of the output file, also for outputs from cache)
+            if ((stat(job->output_path, &st) == 0) && (st.st_size > 44))
+            {
+                job->duration = (uint32_t)((((uint64_t)st.st_size - 44) / (2 * sizeof(int16_t))) * 1000 / frequency);
+            }
+
+            total_audio += job->duration / 1000.0;
+            printf("[%u/%u] %s -> %s: %.2f s audio, %.2f s wall, %.2f s cpu, %.1fx realtime\n", num_done, num_jobs, job->input_path, job->output_path, job->duration / 1000.0, job->wall_time, job->cpu_time, (job->wall_time > 0) ? (job->duration / 1000.0) / job->wall_time : 0.0);
+        }
+    }
+
+    total_wall = get_time() - start_time;
+
+    printf("%u files, %u failed, %u workers: %.2f s audio, %.2f s wall, %.2f s cpu, %.1fx realtime, %.2f files/s\n", num_jobs, num_failed, num_workers, total_audio, total_wall, total_cpu, (total_wall > 0) ? total_audio / total_wall : 0.0, (total_wall > 0) ? (num_jobs - num_failed) / total_wall : 0.0);
+
+    for (index = 0; index < num_jobs; index++)
+    {
+        free(jobs[index].output_path);
+    }
+    free(jobs);
+
+    return num_failed ? 11 : 0;
+}
+
+static int find_sweep_param(const char *name, size_t name_len)
+{
+    unsigned int index;
+
+    for (index = 0; index < sizeof(sweep_params) / sizeof(sweep_params[0]); index++)
+    {
+        if ((strlen(sweep_params[index].name) == name_len) && (strncasecmp(sweep_params[index].name, name, name_len) == 0)) return index;
+    }
+
+    return -1;
+}
+
+static int add_sweep_dimension(const char *spec)
+{
+    sweep_dimension *dimension;
+    const char *values;
+    char *end;
+    long value, last, step;
+    int param;
+
+    // NAME=V1,V2,... or NAME=FIRST:LAST:STEP
+    values = strchr(spec, '=');
+    if ((values == NULL) || (num_sweep_dimensions >= MAX_SWEEP_PARAMS)) return 0;
+
+    param = find_sweep_param(spec, values - spec);
+    if (param < 0) return 0;
+
+    dimension = &(sweep_dimensions[num_sweep_dimensions]);
+    dimension->param = param;
+    dimension->num_values = 0;
+
+    values++;
+    while (*values != 0)
+    {
+        value = strtol(values, &end, 10);
+        if (end == values) return 0;
+
+        last = value;
+        step = 1;
+        if (*end == ':')
+        {
+            values = end + 1;
+            last = strtol(values, &end, 10);
+            if (end == values) return 0;
+            if (*end == ':')
+            {
+                values = end + 1;
+                step = strtol(values, &end, 10);
+                if ((end == values) || (step <= 0)) return 0;
+            }
+        }
+
+        for (; value <= last; value += step)
+        {
+            if ((value < sweep_params[param].min) || (value > sweep_params[param].max) || (dimension->num_values >= MAX_SWEEP_VALUES)) return 0;
+            dimension->values[dimension->num_values] = value;
+            dimension->num_values++;
+        }
+
+        if (*end == ',') end++;
+        else if (*end != 0) return 0;
+        values = end;
+    }
+
+    if (dimension->num_values == 0) return 0;
+
+    num_sweep_dimensions++;
+    return 1;
+}
+
+static void set_sweep_param(sweep_variant *variant, unsigned int param, uint32_t value)
+{
+    size_t len;
+
+    *(uint32_t *)((uint8_t *)&(variant->settings) + sweep_params[param].offset) = value;
+
+    len = strlen(variant->label);
+    snprintf(variant->label + len, sizeof(variant->label) - len, "%s%s%u", (len != 0) ? "_" : "", sweep_params[param].name, value);
+}
+
+static int parse_sweep_line(char *line, sweep_variant *variant)
+{
+    char *token, *value, *end;
+    long number;
+    int param;
+
+    // NAME=VALUE pairs separated by whitespace
+    for (token = strtok(line, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n"))
+    {
+        value = strchr(token, '=');
+        if (value == NULL) return 0;
+
+        param = find_sweep_param(token, value - token);
+        if (param < 0) return 0;
+
+        number = strtol(value + 1, &end, 10);
+        if ((end == value + 1) || (*end != 0) || (number < sweep_params[param].min) || (number > sweep_params[param].max)) return 0;
+
+        set_sweep_param(variant, param, number);
+    }
+
+    return 1;
+}
+
+static sweep_variant *get_sweep_variants(unsigned int *num_variants_ptr)
+{
+    sweep_variant *base_variants, *variants, *variant;
+    unsigned int num_base, num_variants, num_combinations, base, combination, index, divisor;
+    char line[1024];
+    FILE *f;
+
+    // list of variants from file (or the default settings)
+    num_base = 0;
+    base_variants = (sweep_variant *)calloc(MAX_SWEEP_VARIANTS, sizeof(sweep_variant));
+    if (base_variants == NULL) return NULL;
+
+    if (arg_sweep_file != NULL)
+    {
+        f = (strcmp(arg_sweep_file, "-") == 0) ? stdin : fopen(arg_sweep_file, "rt");
+        if (f == NULL)
+        {
+            free(base_variants);
+            return NULL;
+        }
+
+        while (fgets(line, sizeof(line), f) != NULL)
+        {
+            if ((line[strspn(line, " \t\r\n")] == 0) || (line[0] == '#')) continue;
+            if (num_base >= MAX_SWEEP_VARIANTS) break;
+
+            base_variants[num_base].settings = d77_settings;
+            if (!parse_sweep_line(line, &(base_variants[num_base])))
+            {
+                fprintf(stderr, "invalid sweep line: %s", line);
+                if (f != stdin) fclose(f);
+                free(base_variants);
+                return NULL;
+            }
+            num_base++;
+        }
+
+        if (f != stdin) fclose(f);
+    }
+    else
+    {
+        base_variants[0].settings = d77_settings;
+        num_base = 1;
+    }
+
+    // grid of parameter values
+    num_combinations = 1;
+    for (index = 0; index < num_sweep_dimensions; index++)
+    {
+        num_combinations *= sweep_dimensions[index].num_values;
+        if (num_combinations > MAX_SWEEP_VARIANTS) break;
+    }
+
+    if ((num_base == 0) || (num_combinations > MAX_SWEEP_VARIANTS) || ((uint64_t)num_base * num_combinations > MAX_SWEEP_VARIANTS))
+    {
+        free(base_variants);
+        return NULL;
+    }
+
+    num_variants = num_base * num_combinations;
+    variants = (sweep_variant *)calloc(num_variants, sizeof(sweep_variant));
+    if (variants == NULL)
+    {
+        free(base_variants);
+        return NULL;
+    }
+
+    variant = variants;
+    for (base = 0; base < num_base; base++)
+    {
+        for (combination = 0; combination < num_combinations; combination++)
+        {
+            *variant = base_variants[base];
+
+            // the last dimension changes fastest
+            divisor = num_combinations;
+            for (index = 0; index < num_sweep_dimensions; index++)
+            {
+                divisor /= sweep_dimensions[index].num_values;
+                set_sweep_param(variant, sweep_dimensions[index].param, sweep_dimensions[index].values[(combination / divisor) % sweep_dimensions[index].num_values]);
+            }
+
+            if (variant->label[0] == 0) strcpy(variant->label, "default");
+
+            variant++;
+        }
+    }
+
+    free(base_variants);
+
+    *num_variants_ptr = num_variants;
+    return variants;
+}
+
+static char *get_sweep_output_path(const char *input_path, const char *label)
+{
+    char *base_path, *output_path, *slash, *extension;
+    size_t base_len;
+
+    // output path of the input file with the configuration label appended to the name
+    base_path = get_output_path(input_path);
+    if (base_path == NULL) return NULL;
+
+    slash = strrchr(base_path, '/');
+    extension = strrchr((slash != NULL) ? slash + 1 : base_path, '.');
+    base_len = (extension != NULL) ? (size_t)(extension - base_path) : strlen(base_path);
+
+    output_path = (char *)malloc(strlen(base_path) + 1 + strlen(label) + 1);
+    if (output_path != NULL)
+    {
+        sprintf(output_path, "%.*s_%s%s", (int)base_len, base_path, label, (extension != NULL) ? extension : "");
+    }
+
+    free(base_path);
+    return output_path;
+}
+
+static void analyze_output_file(const char *path, sweep_variant *variant)
+{
+    int16_t samples[32768];
+    ssize_t read_bytes;
+    uint64_t num_samples;
+    unsigned int peak;
+    double sum;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+
+    // skip wav header
+    if (lseek(fd, 44, SEEK_SET) != 44)
+    {
+        close(fd);
+        return;
+    }
+
+    num_samples = 0;
+    sum = 0;
+    variant->peak = 0;
+    while ((read_bytes = read(fd, samples, sizeof(samples))) > 0)
+    {
+        unsigned int index, count;
+
+        count = read_bytes / sizeof(int16_t);
+#ifdef BIG_ENDIAN_BYTE_ORDER
+        for (index = 0; index < count; index++)
+        {
+            samples[index] = (int16_t)(((uint16_t)samples[index] >> 8) | ((uint16_t)samples[index] << 8));
+        }
+#endif
+
+        peak = get_peak_level(samples, count);
+        if (peak > variant->peak) variant->peak = peak;
+
+        for (index = 0; index < count; index++)
+        {
+            sum += (double)samples[index] * samples[index];
+        }
+        num_samples += count;
+    }
+
+    close(fd);
+
+    variant->duration = (num_samples / 2) / (double)frequency;
+    variant->rms = (num_samples != 0) ? sqrt(sum / num_samples) : 0;
+}
+
+static double get_level_db(double level)
+{
+    return (level > 0) ? 20 * log10(level / 32768.0) : -INFINITY;
+}
+
+static int convert_sweep(void)
+{
+    sweep_variant *variants, *variant;
+    unsigned int num_variants, next_variant, num_running, num_done, num_failed, num_workers, index;
+    double start_time, total_wall;
+    struct rusage usage;
+    pid_t pid;
+    int status;
+
+    variants = get_sweep_variants(&num_variants);
+    if (variants == NULL)
+    {
+        fprintf(stderr, "error preparing sweep configurations\n");
+        return 11;
+    }
+
+    // variants are written to shared memory by the worker processes
+    variant = (sweep_variant *)map_shared_memory(num_variants * sizeof(sweep_variant));
+    if (variant == NULL)
+    {
+        free(variants);
+        fprintf(stderr, "error allocating memory\n");
+        return 11;
+    }
+    memcpy(variant, variants, num_variants * sizeof(sweep_variant));
+    free(variants);
+    variants = variant;
+
+    num_workers = arg_jobs;
+    if (num_workers == 0)
+    {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_cpus > 0) ? num_cpus : 1;
+    }
+
+    // parse MIDI file once, the worker processes inherit the events
+    if (load_midi_file(arg_input, &timediv, &midi_events))
+    {
+        munmap(variants, num_variants * sizeof(sweep_variant));
+        fprintf(stderr, "error loading MIDI file\n");
+        return 4;
+    }
+
+    for (index = 0; index < num_variants; index++)
+    {
+        variants[index].output_path = get_sweep_output_path(arg_input, variants[index].label);
+        variants[index].result = (variants[index].output_path != NULL) ? -1 : 11;
+    }
+
+    fflush(NULL);
+
+    start_time = get_time();
+    next_variant = 0;
+    num_running = 0;
+    num_done = 0;
+    num_failed = 0;
+
+    while (num_done < num_variants)
+    {
+        // start variants
+        while ((num_running < num_workers) && (next_variant < num_variants))
+        {
+            variant = &(variants[next_variant]);
+            next_variant++;
+
+            if (variant->result >= 0)
+            {
+                num_done++;
+                num_failed++;
+                continue;
+            }
+
+            variant->start_time = get_time();
+            pid = fork();
+            if (pid == 0)
+            {
+                double render_start;
+
+                // initialize synth with the variant's settings, the datafile is already loaded
+                d77_settings = variant->settings;
+                status = initialize_synth();
+                if (status == 0)
+                {
+                    render_start = get_time();
+                    status = render_file(arg_input, variant->output_path);
+                    variant->render_time = get_time() - render_start;
+                    if (status == 0) analyze_output_file(variant->output_path, variant);
+                }
+                fflush(NULL);
+                _exit(status);
+            }
+
+            if (pid < 0)
+            {
+                num_done++;
+                num_failed++;
+                variant->result = 11;
+                continue;
+            }
+
+            variant->pid = pid;
+            num_running++;
+        }
+
+        if (num_running == 0) continue;
+
+        pid = wait4(-1, &status, 0, &usage);
+        if (pid < 0) break;
+
+        for (index = 0; index < num_variants; index++)
+        {
+            if (variants[index].pid == pid) break;
+        }
+        if (index >= num_variants) continue;
+
+        variant = &(variants[index]);
+        variant->pid = 0;
+        variant->wall_time = get_time() - variant->start_time;
+        variant->cpu_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+        variant->result = WIFEXITED(status) ? WEXITSTATUS(status) : 12;
+        num_running--;
+        num_done++;
+        if (variant->result) num_failed++;
+    }
+
+    total_wall = get_time() - start_time;
+
+    // comparison table
+    printf("%-40s %9s %9s %9s %9s %9s %9s %9s\n", "configuration", "duration", "peak", "peak dB", "rms dB", "render s", "cpu s", "realtime");
+    for (index = 0; index < num_variants; index++)
+    {
+        variant = &(variants[index]);
+        if (variant->result)
+        {
+            printf("%-40s error %i\n", variant->label, variant->result);
+        }
+        else
+        {
+            printf("%-40s %9.3f %9u %9.2f %9.2f %9.3f %9.3f %9.1f\n", variant->label, variant->duration, variant->peak, get_level_db(variant->peak), get_level_db(variant->rms), variant->render_time, variant->cpu_time, (variant->render_time > 0) ? variant->duration / variant->render_time : 0.0);
+        }
+    }
+    printf("%u configurations, %u failed, %u workers: %.2f s wall\n", num_variants, num_failed, num_workers, total_wall);
+
+    for (index = 0; index < num_variants; index++)
+    {
+        free(variants[index].output_path);
+    }
+    munmap(variants, num_variants * sizeof(sweep_variant));
+
+    free_midi_data(midi_events);
+    midi_events = NULL;
+
+    return num_failed ? 11 : 0;
+}
+#endif
+
+#ifndef _WIN32
+static int render_calls(unsigned int first_call, unsigned int start_call, unsigned int end_call, unsigned int last_call, uint8_t *output, uint8_t *extra_output)
+{
+    unsigned int num_calls, remaining_events;
+    const midi_event_info *cur_event;
+    uint64_t next_time;
+
+    remaining_events = midi_events[0].len;
+    cur_event = midi_events + 1;
+
+    // chase the state (programs, controllers, sysex, ...) up to the first rendered call, without notes
+    if (first_call != 0)
+    {
+        next_time = d77r_get_call_time(renderer, first_call);
+        seek_events(next_time, &cur_event, &remaining_events);
+
+        while ((remaining_events > 0) && (cur_event->time <= next_time))
+        {
+            if (!is_note_event(cur_event))
+            {
+                d77r_send_event(renderer, cur_event);
+            }
+
+            cur_event++;
+            remaining_events--;
+        }
+    }
+
+    // calls up to start_call are pre-roll (not stored), calls up to end_call are stored in output, the rest in extra_output
+    for (num_calls = first_call + 1; num_calls <= last_call; num_calls++)
+    {
+        d77r_send_events(renderer, num_calls, &cur_event, &remaining_events);
+
+        if (!D77_RenderSamples(output_buffer)) return 0;
+
+        if (num_calls > end_call)
+        {
+            memcpy(extra_output + (size_t)(num_calls - 1 - end_call) * bytes_per_call, output_buffer, bytes_per_call);
+        }
+        else if (num_calls > start_call)
+        {
+            memcpy(output + (size_t)(num_calls - 1 - start_call) * bytes_per_call, output_buffer, bytes_per_call);
+        }
+    }
+
+    return 1;
+}
+
+static int render_segments(const char *input_path, const char *output_path)
+{
+    unsigned int total_calls, preroll_calls, crossfade_calls, segment, start_call, end_call, num_failed, num_workers, num_running, index;
+    size_t data_length, crossfade_length;
+    uint8_t *data, *crossfade_data, *mapped, *reference;
+    int return_value, fd, status;
+    double start_time, parallel_time, serial_time;
+    pid_t pid;
+
+    // load MIDI file
+    if (load_midi_file(input_path, &timediv, &midi_events))
+    {
+        fprintf(stderr, "error loading MIDI file\n");
+        return 4;
+    }
+
+    if (optimize_mode && !optimize_events(NULL))
+    {
+        free_midi_data(midi_events);
+        midi_events = NULL;
+        fprintf(stderr, "error allocating memory\n");
+        return 7;
+    }
+
+    return_value = 0;
+    fd = -1;
+    mapped = data = crossfade_data = reference = NULL;
+
+    total_calls = d77r_get_total_calls(renderer, midi_events[0].time + 112000);
+    preroll_calls = (unsigned int)(((uint64_t)arg_preroll * frequency + 1000 * (uint64_t)samples_per_call - 1) / (1000 * (uint64_t)samples_per_call));
+    crossfade_calls = (unsigned int)(((uint64_t)arg_crossfade * frequency + 1000 * (uint64_t)samples_per_call - 1) / (1000 * (uint64_t)samples_per_call));
+
+    if (arg_segments > total_calls) arg_segments = total_calls;
+    if (arg_segments == 0) arg_segments = 1;
+    if (crossfade_calls > total_calls / arg_segments) crossfade_calls = total_calls / arg_segments;
+
+    data_length = (size_t)total_calls * bytes_per_call;
+    crossfade_length = (size_t)crossfade_calls * bytes_per_call;
+
+    // segments are rendered directly into the (memory mapped) output file
+    if (output_path != NULL)
+    {
+        fd = open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0)
+        {
+            fprintf(stderr, "error opening output file\n");
+            return_value = 8;
+            goto exit;
+        }
+
+        if (ftruncate(fd, 44 + data_length))
+        {
+            fprintf(stderr, "error writing to output file\n");
+            return_value = 9;
+            goto exit;
+        }
+
+        mapped = (uint8_t *)mmap(NULL, 44 + data_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            mapped = NULL;
+            fprintf(stderr, "error writing to output file\n");
+            return_value = 9;
+            goto exit;
+        }
+        data = mapped + 44;
+    }
+    else
+    {
+        data = (uint8_t *)map_shared_memory(data_length + 1);
+        if (data == NULL)
+        {
+            fprintf(stderr, "error allocating output buffer\n");
+            return_value = 7;
+            goto exit;
+        }
+    }
+
+    // segment ends overlapping the next segment, for crossfade
+    if (arg_segments > 1)
+    {
+        crossfade_data = (uint8_t *)map_shared_memory((arg_segments - 1) * crossfade_length + 1);
+        if (crossfade_data == NULL)
+        {
+            fprintf(stderr, "error allocating output buffer\n");
+            return_value = 7;
+            goto exit;
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    num_workers = arg_jobs;
+    if (num_workers == 0)
+    {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_cpus > 0) ? num_cpus : 1;
+    }
+
+    // each segment is rendered in a child process forked from the initialized synth (at most -j processes at once)
+    start_time = get_time();
+    num_failed = num_running = 0;
+    for (segment = 0; segment < arg_segments; segment++)
+    {
+        if (num_running >= num_workers)
+        {
+            if (wait(&status) < 0) break;
+            if (!WIFEXITED(status) || WEXITSTATUS(status)) num_failed++;
+            num_running--;
+        }
+
+        pid = fork();
+        if (pid == 0)
+        {
+            start_call = (unsigned int)(((uint64_t)total_calls * segment) / arg_segments);
+            end_call = (unsigned int)(((uint64_t)total_calls * (segment + 1)) / arg_segments);
+
+            if (segment + 1 < arg_segments)
+            {
+                // segment continues into the next segment, for crossfade
+                status = render_calls((start_call > preroll_calls) ? start_call - preroll_calls : 0, start_call, end_call, end_call + crossfade_calls, data + (size_t)start_call * bytes_per_call, crossfade_data + segment * crossfade_length);
+            }
+            else
+            {
+                status = render_calls((start_call > preroll_calls) ? start_call - preroll_calls : 0, start_call, end_call, end_call, data + (size_t)start_call * bytes_per_call, NULL);
+            }
+            _exit(status ? 0 : 10);
+        }
+
+        if (pid < 0)
+        {
+            fprintf(stderr, "error forking process\n");
+            return_value = 11;
+            break;
+        }
+
+        num_running++;
+    }
+
+    if ((return_value == 0) && (segment < arg_segments))
+    {
+        fprintf(stderr, "error waiting for process\n");
+        return_value = 11;
+    }
+
+    while (wait(&status) > 0)
+    {
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) num_failed++;
+    }
+    parallel_time = get_time() - start_time;
+
+    if ((return_value == 0) && num_failed)
+    {
+        fprintf(stderr, "error rendering samples\n");
+        return_value = 10;
+    }
+    if (return_value) goto exit;
+
+    // crossfade the overlapping parts of the segments
+    for (segment = 0; segment + 1 < arg_segments; segment++)
+    {
+        int16_t *next_samples, *previous_samples;
+        unsigned int num_samples;
+
+        end_call = (unsigned int)(((uint64_t)total_calls * (segment + 1)) / arg_segments);
+        next_samples = (int16_t *)(data + (size_t)end_call * bytes_per_call);
+        previous_samples = (int16_t *)(crossfade_data + segment * crossfade_length);
+        num_samples = crossfade_calls * samples_per_call;
+
+        for (index = 0; index < num_samples; index++)
+        {
+            next_samples[2 * index] = (int16_t)((previous_samples[2 * index] * (int64_t)(num_samples - index) + next_samples[2 * index] * (int64_t)index) / num_samples);
+            next_samples[2 * index + 1] = (int16_t)((previous_samples[2 * index + 1] * (int64_t)(num_samples - index) + next_samples[2 * index + 1] * (int64_t)index) / num_samples);
+        }
+    }
+
+    if (validate_mode)
+    {
+        int16_t *samples, *reference_samples;
+        uint64_t num_samples, max_position, sample_index;
+        unsigned int deviation, max_deviation, seam_deviation;
+        double sum;
+
+        reference = (uint8_t *)map_shared_memory(data_length + 1);
+        if (reference == NULL)
+        {
+            fprintf(stderr, "error allocating output buffer\n");
+            return_value = 7;
+            goto exit;
+        }
+
+        // serial render for comparison
+        start_time = get_time();
+        pid = fork();
+        if (pid == 0)
+        {
+            _exit(render_calls(0, 0, total_calls, total_calls, reference, NULL) ? 0 : 10);
+        }
+        if ((pid < 0) || (waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || WEXITSTATUS(status))
+        {
+            fprintf(stderr, "error rendering samples\n");
+            return_value = 10;
+            goto exit;
+        }
+        serial_time = get_time() - start_time;
+
+        samples = (int16_t *)data;
+        reference_samples = (int16_t *)reference;
+        num_samples = (uint64_t)total_calls * samples_per_call * 2;
+
+        max_deviation = 0;
+        max_position = 0;
+        sum = 0;
+        for (sample_index = 0; sample_index < num_samples; sample_index++)
+        {
+            deviation = abs(samples[sample_index] - reference_samples[sample_index]);
+            sum += (double)deviation * deviation;
+            if (deviation > max_deviation)
+            {
+                max_deviation = deviation;
+                max_position = sample_index;
+            }
+        }
+
+        fprintf(stderr, "%u segments: %.2f s parallel, %.2f s serial (%.2fx)\n", arg_segments, parallel_time, serial_time, (parallel_time > 0) ? serial_time / parallel_time : 0.0);
+        fprintf(stderr, "max deviation: %u (at %.3f s), rms deviation: %.3f\n", max_deviation, (max_position / 2) / (double)frequency, (num_samples != 0) ? sqrt(sum / num_samples) : 0.0);
+
+        // deviation in the pre-roll and crossfade area after each seam
+        for (segment = 1; segment < arg_segments; segment++)
+        {
+            start_call = (unsigned int)(((uint64_t)total_calls * segment) / arg_segments);
+            end_call = start_call + preroll_calls + crossfade_calls;
+            if (end_call > total_calls) end_call = total_calls;
+
+            seam_deviation = 0;
+            for (sample_index = (uint64_t)start_call * samples_per_call * 2; sample_index < (uint64_t)end_call * samples_per_call * 2; sample_index++)
+            {
+                deviation = abs(samples[sample_index] - reference_samples[sample_index]);
+                if (deviation > seam_deviation) seam_deviation = deviation;
+            }
+
+            fprintf(stderr, "seam %u (at %.3f s): max deviation %u\n", segment, (start_call * (uint64_t)samples_per_call) / (double)frequency, seam_deviation);
+        }
+    }
+
+#ifdef BIG_ENDIAN_BYTE_ORDER
+    // swap values to little-endian
+    {
+        size_t i;
+        for (i = 0; i < data_length; i += 2)
+        {
+            uint8_t value;
+            value = data[i];
+            data[i] = data[i + 1];
+            data[i + 1] = value;
+        }
+    }
+#endif
+
+    if (output_path != NULL)
+    {
+        d77r_write_wav_header(mapped, frequency, data_length);
+    }
+    else
+    {
+        output_stream out;
+
+        if (!output_open(&out, NULL))
+        {
+            fprintf(stderr, "error opening output file\n");
+            return_value = 8;
+            goto exit;
+        }
+
+        if (!output_write(&out, data, data_length) || !output_flush(&out))
+        {
+            fprintf(stderr, "error writing to output file\n");
+            return_value = 9;
+        }
+
+        output_close(&out);
+    }
+
+exit:
+    if (reference != NULL) munmap(reference, data_length + 1);
+    if (crossfade_data != NULL) munmap(crossfade_data, (arg_segments - 1) * crossfade_length + 1);
+    if (mapped != NULL)
+    {
+        munmap(mapped, 44 + data_length);
+    }
+    else if (data != NULL)
+    {
+        munmap(data, data_length + 1);
+    }
+    if ((fd >= 0) && close(fd) && (return_value == 0))
+    {
+        fprintf(stderr, "error writing to output file\n");
+        return_value = 9;
+    }
+
+    free_midi_data(midi_events);
+    midi_events = NULL;
+
+    return return_value;
+}
+#endif
+
+#ifndef _WIN32
+static double get_raw_time(void)
+{
+    struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static double get_cpu_time(const struct rusage *usage)
+{
+    return usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1000000.0 + usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1000000.0;
+}
+
+static void print_json_string(const char *str)
+{
+    putchar('"');
+    for (; *str != 0; str++)
+    {
+        if ((*str == '"') || (*str == '\\'))
+        {
+            printf("\\%c", *str);
+        }
+        else if ((uint8_t)*str < 0x20)
+        {
+            printf("\\u%04x", (uint8_t)*str);
+        }
+        else
+        {
+            putchar(*str);
+        }
+    }
+    putchar('"');
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+    return (*(const uint32_t *)a > *(const uint32_t *)b) - (*(const uint32_t *)a < *(const uint32_t *)b);
+}
+
+static int bench_file(const char *input_path)
+{
+    unsigned int num_calls, total_calls, remaining_events, num_sent, index, bucket;
+    unsigned int histogram[32];
+    uint32_t *latencies;
+    uint64_t next_time;
+    const midi_event_info *cur_event;
+    double start_time, load_time, event_time, render_time, call_start, call_end, wall_time, cpu_time, audio_time;
+    uint64_t latency_sum;
+    struct rusage usage_start, usage_end;
+    const char *arch;
+
+    start_time = get_raw_time();
+    getrusage(RUSAGE_SELF, &usage_start);
+
+    // load MIDI file
+    if (load_midi_file(input_path, &timediv, &midi_events))
+    {
+        fprintf(stderr, "error loading MIDI file\n");
+        return 4;
+    }
+
+    load_time = get_raw_time() - start_time;
+
+    if (optimize_mode && !optimize_events(NULL))
+    {
+        free_midi_data(midi_events);
+        midi_events = NULL;
+        fprintf(stderr, "error allocating memory\n");
+        return 7;
+    }
+
+    total_calls = d77r_get_total_calls(renderer, midi_events[0].time + 112000);
+    latencies = (uint32_t *)malloc((total_calls + 1) * sizeof(uint32_t));
+    if (latencies == NULL)
+    {
+        free_midi_data(midi_events);
+        midi_events = NULL;
+        fprintf(stderr, "error allocating memory\n");
+        return 7;
+    }
+
+    // render to null sink, event processing is measured separately from rendering
+    remaining_events = midi_events[0].len;
+    cur_event = midi_events + 1;
+    num_sent = 0;
+    event_time = 0;
+    render_time = 0;
+    latency_sum = 0;
+    for (num_calls = 1; num_calls <= total_calls; num_calls++)
+    {
+        next_time = d77r_get_call_time(renderer, num_calls);
+        if ((remaining_events > 0) && (cur_event->time <= next_time))
+        {
+            call_start = get_raw_time();
+            num_sent += d77r_send_events(renderer, num_calls, &cur_event, &remaining_events);
+            event_time += get_raw_time() - call_start;
+        }
+
+        call_start = get_raw_time();
+        if (!D77_RenderSamples(output_buffer))
+        {
+            free(latencies);
+            free_midi_data(midi_events);
+            midi_events = NULL;
+            fprintf(stderr, "error rendering samples\n");
+            return 10;
+        }
+        call_end = get_raw_time();
+
+        render_time += call_end - call_start;
+        latencies[num_calls - 1] = (uint32_t)((call_end - call_start) * 1000000000.0 + 0.5);
+        latency_sum += latencies[num_calls - 1];
+    }
+
+    wall_time = get_raw_time() - start_time;
+    getrusage(RUSAGE_SELF, &usage_end);
+    cpu_time = get_cpu_time(&usage_end) - get_cpu_time(&usage_start);
+    audio_time = (total_calls * (uint64_t)samples_per_call) / (double)frequency;
+
+    // histogram with power of 2 buckets (in microseconds)
+    memset(histogram, 0, sizeof(histogram));
+    for (index = 0; index < total_calls; index++)
+    {
+        bucket = 0;
+        while ((bucket < 31) && ((latencies[index] / 1000) >= (1u << bucket))) bucket++;
+        histogram[bucket]++;
+    }
+
+    if (total_calls == 0) latencies[0] = 0;
+    qsort(latencies, total_calls, sizeof(uint32_t), compare_latencies);
+
+#if defined(__x86_64__) || defined(_M_X64)
+    arch = "x64";
+#elif defined(__i386__) || defined(_M_IX86)
+    arch = "x86";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    arch = "aarch64";
+#elif defined(__arm__)
+    arch = "armv7";
+#elif defined(__riscv)
+    arch = "riscv64";
+#else
+    arch = "unknown";
+#endif
+
+    printf("{\n");
+    printf("  \"file\": ");
+    print_json_string(input_path);
+    printf(",\n");
+    printf("  \"arch\": \"%s\",\n", arch);
+#if defined(PTROFS_64BIT)
+    printf("  \"backend\": \"ptrofs\",\n");
+#elif defined(INDIRECT_64BIT)
+    printf("  \"backend\": \"indirect\",\n");
+    printf("  \"library\": ");
+    print_json_string((arg_lib != NULL) ? arg_lib : "(embedded)");
+    printf(",\n");
+#else
+    printf("  \"backend\": \"direct\",\n");
+#endif
+    printf("  \"frequency\": %u,\n", frequency);
+    printf("  \"polyphony\": %u,\n", (unsigned int)d77_settings.dwPolyphony);
+    printf("  \"samples_per_call\": %u,\n", samples_per_call);
+    printf("  \"calls\": %u,\n", total_calls);
+    printf("  \"events\": %u,\n", num_sent);
+    printf("  \"audio_seconds\": %.6f,\n", audio_time);
+    printf("  \"startup_seconds\": %.6f,\n", startup_time);
+    printf("  \"load_seconds\": %.6f,\n", load_time);
+    printf("  \"load_events_per_second\": %.0f,\n", (load_time > 0) ? midi_events[0].len / load_time : 0.0);
+    if (optimize_mode)
+    {
+        printf("  \"optimize\": { \"events_dropped\": %u, \"events_before\": %u, \"seconds\": %.6f },\n", optimize_dropped, midi_events[0].len + optimize_dropped, optimize_time);
+    }
+    printf("  \"wall_seconds\": %.6f,\n", wall_time);
+    printf("  \"cpu_seconds\": %.6f,\n", cpu_time);
+    printf("  \"render_seconds\": %.6f,\n", render_time);
+    printf("  \"event_seconds\": %.6f,\n", event_time);
+    printf("  \"realtime_factor\": %.3f,\n", (wall_time > 0) ? audio_time / wall_time : 0.0);
+    printf("  \"latency_us\": { \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f, \"budget\": %.3f },\n",
+        latencies[0] / 1000.0,
+        (total_calls != 0) ? (latency_sum / (double)total_calls) / 1000.0 : 0.0,
+        latencies[(total_calls * (uint64_t)500) / 1000] / 1000.0,
+        latencies[(total_calls * (uint64_t)990) / 1000] / 1000.0,
+        latencies[(total_calls * (uint64_t)999) / 1000] / 1000.0,
+        latencies[(total_calls != 0) ? total_calls - 1 : 0] / 1000.0,
+        (samples_per_call * 1000000.0) / frequency
+    );
+    printf("  \"histogram_us\": [");
+    for (bucket = 31; (bucket > 0) && (histogram[bucket] == 0); bucket--);
+    for (index = 0; index <= bucket; index++)
+    {
+        printf("%s{ \"lt\": %u, \"count\": %u }", (index != 0) ? ", " : "", 1u << index, histogram[index]);
+    }
+    printf("],\n");
+    // ru_maxrss is in kilobytes on Linux, in bytes on macOS
+#ifdef __APPLE__
+    printf("  \"peak_rss_kb\": %li\n", (long)(usage_end.ru_maxrss / 1024));
+#else
+    printf("  \"peak_rss_kb\": %li\n", (long)usage_end.ru_maxrss);
+#endif
+    printf("}\n");
+
+    free(latencies);
+    free_midi_data(midi_events);
+    midi_events = NULL;
+
+    return 0;
+}
+
+static uint8_t *put_varlen(uint8_t *ptr, unsigned int value)
+{
+    unsigned int shift;
+
+    for (shift = 21; (shift != 0) && ((value >> shift) == 0); shift -= 7);
+    for (; shift != 0; shift -= 7)
+    {
+        *ptr++ = 0x80 | ((value >> shift) & 0x7f);
+    }
+    *ptr++ = value & 0x7f;
+
+    return ptr;
+}
+
+static uint8_t *create_synthetic_midi(unsigned int num_tracks, unsigned int num_track_events, unsigned int *length)
+{
+    static const uint8_t deltas[8] = { 0, 0, 0, 1, 2, 6, 12, 48 };
+    uint8_t *midi, *ptr, *track_start;
+    unsigned int track, index, channel, random;
+    size_t size;
+
+    // type 1 file, each event takes at most 7 bytes (4 byte delta + 3 byte message)
+    size = 14 + (size_t)num_tracks * (8 + (size_t)num_track_events * 7 + 4);
+    if (size > UINT32_MAX) return NULL;
+
+    midi = (uint8_t *)malloc(size);
+    if (midi == NULL) return NULL;
+
+    memcpy(midi, "MThd\0\0\0\6\0\1", 10);
+    midi[10] = num_tracks >> 8;
+    midi[11] = num_tracks & 0xff;
+    midi[12] = 0;
+    midi[13] = 96;
+
+    // pseudo-random notes and controllers with many events at the same tick in different tracks, tempo changes in first track
+    random = 1;
+    ptr = midi + 14;
+    for (track = 0; track < num_tracks; track++)
+    {
+        memcpy(ptr, "MTrk", 4);
+        track_start = ptr + 8;
+        ptr = track_start;
+        channel = track & 15;
+
+        for (index = 0; index < num_track_events; index++)
+        {
+            random = random * 1103515245 + 12345;
+            ptr = put_varlen(ptr, deltas[(random >> 16) & 7]);
+
+            if ((track == 0) && ((index & 63) == 63))
+            {
+                *ptr++ = 0xff;
+                *ptr++ = 0x51;
+                *ptr++ = 3;
+                *ptr++ = 0x07;
+                *ptr++ = (random >> 8) & 0xff;
+                *ptr++ = (random >> 24) & 0xff;
+            }
+            else if ((index & 15) == 15)
+            {
+                *ptr++ = 0xb0 | channel;
+                *ptr++ = (random >> 20) & 0x7f;
+                *ptr++ = (random >> 8) & 0x7f;
+            }
+            else
+            {
+                *ptr++ = ((index & 1) ? 0x80 : 0x90) | channel;
+                *ptr++ = (random >> 12) & 0x7f;
+                *ptr++ = 64;
+            }
+        }
+
+        memcpy(ptr, "\0\xff\x2f\0", 4);
+        ptr += 4;
+
+        track_start[-4] = (uint8_t)((ptr - track_start) >> 24);
+        track_start[-3] = (uint8_t)((ptr - track_start) >> 16);
+        track_start[-2] = (uint8_t)((ptr - track_start) >> 8);
+        track_start[-1] = (uint8_t)(ptr - track_start);
+    }
+
+    *length = ptr - midi;
+    return midi;
+}
+
+static int bench_parse(unsigned int num_tracks, unsigned int num_track_events)
+{
+    uint8_t *midi;
+    unsigned int length, num_events, run, local_timediv, index;
+    double start_time, parse_time, best_time, total_time, iterate_time, best_iterate_time, free_time, best_free_time;
+    midi_event_info *events;
+    uint64_t checksum;
+
+    midi = create_synthetic_midi(num_tracks, num_track_events, &length);
+    if (midi == NULL)
+    {
+        fprintf(stderr, "error allocating memory\n");
+        return 7;
+    }
+
+    // parse the file repeatedly, best time is reported
+    num_events = 0;
+    best_time = 0;
+    best_iterate_time = 0;
+    best_free_time = 0;
+    total_time = 0;
+    checksum = 0;
+    for (run = 0; run < BENCH_PARSE_RUNS; run++)
+    {
+        start_time = get_raw_time();
+        if (load_midi_data(midi, length, &local_timediv, &events))
+        {
+            free(midi);
+            fprintf(stderr, "error parsing MIDI data\n");
+            return 4;
+        }
+        parse_time = get_raw_time() - start_time;
+
+        num_events = events[0].len;
+
+        // sequential scan of the events like in the render loop (time and message)
+        start_time = get_raw_time();
+        for (index = 1; index <= num_events; index++)
+        {
+            checksum += events[index].time + MIDI_EVENT_DATA(&(events[index]))[0];
+        }
+        iterate_time = get_raw_time() - start_time;
+
+        start_time = get_raw_time();
+        free_midi_data(events);
+        free_time = get_raw_time() - start_time;
+
+        total_time += parse_time;
+        if ((run == 0) || (parse_time < best_time)) best_time = parse_time;
+        if ((run == 0) || (iterate_time < best_iterate_time)) best_iterate_time = iterate_time;
+        if ((run == 0) || (free_time < best_free_time)) best_free_time = free_time;
+    }
+
+    free(midi);
+
+    printf("{\n");
+    printf("  \"tracks\": %u,\n", num_tracks);
+    printf("  \"track_events\": %u,\n", num_track_events);
+    printf("  \"file_bytes\": %u,\n", length);
+    printf("  \"events\": %u,\n", num_events);
+    printf("  \"event_bytes\": %u,\n", (unsigned int)sizeof(midi_event_info));
+    printf("  \"runs\": %u,\n", BENCH_PARSE_RUNS);
+    printf("  \"parse_seconds\": { \"best\": %.6f, \"mean\": %.6f },\n", best_time, total_time / BENCH_PARSE_RUNS);
+    printf("  \"events_per_second\": %.0f,\n", (best_time > 0) ? num_events / best_time : 0.0);
+    printf("  \"iterate_seconds\": %.6f,\n", best_iterate_time);
+    printf("  \"iterate_events_per_second\": %.0f,\n", (best_iterate_time > 0) ? num_events / best_iterate_time : 0.0);
+    printf("  \"free_seconds\": %.6f,\n", best_free_time);
+    printf("  \"checksum\": %llu\n", (unsigned long long)checksum);
+    printf("}\n");
+
+    return 0;
+}
+
+typedef struct
+{
+    uint64_t start_time, end_time;
+    uint8_t channel, note, state; // state: 0 = free, 1 = note on, 2 = held by sustain pedal, 3 = released (until end time)
+} estimate_voice;
+
+typedef struct
+{
+    unsigned int polyphony, count, peak, num_notes, num_stolen, num_intervals;
+    uint64_t time, peak_time;
+    double voice_time; // in voice-microseconds
+    uint16_t *interval_max;
+    double *interval_sum;
+    uint8_t sustain[16];
+    estimate_voice voices[256];
+} voice_estimate;
+
+static void estimate_advance(voice_estimate *est, uint64_t time)
+{
+    unsigned int index, last;
+    uint64_t start, end;
+
+    // the voice count is constant since the last time
+    if (time <= est->time) return;
+
+    index = (unsigned int)(est->time / (ESTIMATE_INTERVAL * 1000));
+    last = (unsigned int)((time - 1) / (ESTIMATE_INTERVAL * 1000));
+    if (last >= est->num_intervals) last = est->num_intervals - 1;
+
+    for (; index <= last; index++)
+    {
+        start = (uint64_t)index * (ESTIMATE_INTERVAL * 1000);
+        end = start + ESTIMATE_INTERVAL * 1000;
+        if (start < est->time) start = est->time;
+        if (end > time) end = time;
+
+        if (end > start) est->interval_sum[index] += est->count * (double)(end - start);
+        if (est->count > est->interval_max[index]) est->interval_max[index] = est->count;
+    }
+
+    est->voice_time += est->count * (double)(time - est->time);
+    est->time = time;
+}
+
+static void estimate_expire(voice_estimate *est, uint64_t time)
+{
+    estimate_voice *voice, *first;
+    unsigned int index;
+
+    // released voices end in time order
+    for (;;)
+    {
+        first = NULL;
+        for (index = 0; index < est->polyphony; index++)
+        {
+            voice = &(est->voices[index]);
+            if ((voice->state == 3) && (voice->end_time <= time) && ((first == NULL) || (voice->end_time < first->end_time))) first = voice;
+        }
+        if (first == NULL) break;
+
+        estimate_advance(est, first->end_time);
+        first->state = 0;
+        est->count--;
+    }
+
+    estimate_advance(est, time);
+}
+
+static void estimate_release(voice_estimate *est, estimate_voice *voice)
+{
+    if (est->sustain[voice->channel])
+    {
+        voice->state = 2;
+    }
+    else
+    {
+        voice->state = 3;
+        voice->end_time = est->time + ESTIMATE_RELEASE_TIME * 1000;
+    }
+}
+
+static void estimate_note_on(voice_estimate *est, unsigned int channel, unsigned int note)
+{
+    estimate_voice *voice, *stolen;
+    unsigned int index;
+
+    est->num_notes++;
+
+    // retriggered note releases the previous voice
+    voice = NULL;
+    for (index = 0; index < est->polyphony; index++)
+    {
+        if (((est->voices[index].state == 1) || (est->voices[index].state == 2)) && (est->voices[index].channel == channel) && (est->voices[index].note == note))
+        {
+            est->voices[index].state = 3;
+            est->voices[index].end_time = est->time + ESTIMATE_RELEASE_TIME * 1000;
+        }
+        if ((voice == NULL) && (est->voices[index].state == 0)) voice = &(est->voices[index]);
+    }
+
+    if (voice == NULL)
+    {
+        // all voices are used - the released voice which ends first or the oldest voice is stolen
+        stolen = NULL;
+        for (index = 0; index < est->polyphony; index++)
+        {
+            voice = &(est->voices[index]);
+            if (stolen == NULL)
+            {
+                stolen = voice;
+            }
+            else if (voice->state == 3)
+            {
+                if ((stolen->state != 3) || (voice->end_time < stolen->end_time)) stolen = voice;
+            }
+            else if ((stolen->state != 3) && (voice->start_time < stolen->start_time))
+            {
+                stolen = voice;
+            }
+        }
+
+        voice = stolen;
+        est->num_stolen++;
+    }
+    else
+    {
+        est->count++;
+        if (est->count > est->peak)
+        {
+            est->peak = est->count;
+            est->peak_time = est->time;
+        }
+    }
+
+    voice->channel = channel;
+    voice->note = note;
+    voice->start_time = est->time;
+    if (channel == 9)
+    {
+        // drum notes ignore note off
+        voice->state = 3;
+        voice->end_time = est->time + ESTIMATE_DRUM_TIME * 1000;
+    }
+    else
+    {
+        voice->state = 1;
+    }
+}
+
+static void estimate_sound_off(voice_estimate *est, int channel)
+{
+    unsigned int index;
+
+    // voices end immediately (channel -1 = all channels)
+    for (index = 0; index < est->polyphony; index++)
+    {
+        if ((est->voices[index].state != 0) && ((channel < 0) || (est->voices[index].channel == channel)))
+        {
+            est->voices[index].state = 0;
+            est->count--;
+        }
+    }
+}
+
+static void estimate_event(voice_estimate *est, const midi_event_info *event)
+{
+    const uint8_t *data;
+    unsigned int channel, index;
+    estimate_voice *voice;
+
+    data = MIDI_EVENT_DATA(event);
+
+    if ((event->len > 3) || ((data[0] & 0xf0) == 0xf0))
+    {
+        if (is_midi_reset(event))
+        {
+            estimate_sound_off(est, -1);
+            memset(est->sustain, 0, sizeof(est->sustain));
+        }
+        return;
+    }
+
+    channel = data[0] & 0x0f;
+    switch (data[0] & 0xf0)
+    {
+        case 0x90:
+            if (data[2] != 0)
+            {
+                estimate_note_on(est, channel, data[1]);
+                break;
+            }
+            // fallthrough
+        case 0x80:
+            for (index = 0; index < est->polyphony; index++)
+            {
+                voice = &(est->voices[index]);
+                if ((voice->state == 1) && (voice->channel == channel) && (voice->note == data[1])) estimate_release(est, voice);
+            }
+            break;
+        case 0xb0:
+            if (data[1] == 64)
+            {
+                // sustain pedal
+                est->sustain[channel] = (data[2] >= 64) ? 1 : 0;
+                if (est->sustain[channel]) break;
+            }
+            else if (data[1] == 121)
+            {
+                // reset all controllers
+                est->sustain[channel] = 0;
+            }
+            else if ((data[1] == 120) || (data[1] >= 124))
+            {
+                // all sounds off (omni / mono / poly mode messages are processed the same way)
+                estimate_sound_off(est, channel);
+                break;
+            }
+            else if (data[1] != 123)
+            {
+                break;
+            }
+
+            // release notes (all notes off) or held notes (sustain pedal off)
+            for (index = 0; index < est->polyphony; index++)
+            {
+                voice = &(est->voices[index]);
+                if ((voice->channel != channel) || (voice->state == 0) || (voice->state == 3)) continue;
+                if ((data[1] == 123) && (voice->state == 1)) estimate_release(est, voice);
+                else if ((voice->state == 2) && !est->sustain[channel]) estimate_release(est, voice);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static int read_calibration(const char *path)
+{
+    FILE *f;
+    char line[256], name[32];
+    double value;
+    unsigned int found;
+    int valid;
+
+    f = fopen(path, "rt");
+    if (f == NULL) return 0;
+
+    // calibration is valid only for the settings with which it was measured
+    valid = 1;
+    found = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if ((line[0] == '#') || (sscanf(line, "%31s %lf", name, &value) != 2)) continue;
+
+        if (strcmp(name, "frequency") == 0)
+        {
+            if ((uint32_t)value != d77_settings.dwSamplingFreq) valid = 0;
+        }
+        else if (strcmp(name, "reverb") == 0)
+        {
+            if ((value != 0) != (d77_settings.dwRevSw != 0)) valid = 0;
+        }
+        else if (strcmp(name, "chorus") == 0)
+        {
+            if ((value != 0) != (d77_settings.dwChoSw != 0)) valid = 0;
+        }
+        else if (strcmp(name, "cpuload") == 0)
+        {
+            if ((uint32_t)value != d77_settings.dwCpuLoadL) valid = 0;
+        }
+        else if (strcmp(name, "base") == 0)
+        {
+            calibration_base = value;
+            found |= 1;
+        }
+        else if (strcmp(name, "voice") == 0)
+        {
+            calibration_voice = value;
+            found |= 2;
+        }
+    }
+
+    fclose(f);
+    return valid && (found == 3);
+}
+
+static int measure_calibration(const char *path)
+{
+    unsigned int level, voices, index, channel, num_calls, call;
+    double levels[CALIBRATION_LEVELS], costs[CALIBRATION_LEVELS];
+    double audio_time, sum_x, sum_y, sum_xx, sum_xy;
+    struct rusage usage_start, usage_end;
+    FILE *f;
+
+    fprintf(stderr, "measuring render cost calibration\n");
+
+    num_calls = (CALIBRATION_SECONDS * frequency) / samples_per_call;
+    audio_time = (num_calls * (uint64_t)samples_per_call) / (double)frequency;
+
+    // render time per audio second is measured with increasing number of sustained voices (up to the polyphony)
+    for (level = 0; level < CALIBRATION_LEVELS; level++)
+    {
+        voices = (d77_settings.dwPolyphony * level) / (CALIBRATION_LEVELS - 1);
+
+        for (channel = 0; channel < 16; channel++)
+        {
+            D77_MidiMessageShort(0xb0 | channel | (120 << 8));
+            D77_MidiMessageShort(0xb0 | channel | (121 << 8));
+            D77_MidiMessageShort(0xc0 | channel | (CALIBRATION_PROGRAM << 8));
+        }
+
+        // notes are spread over the melodic channels
+        for (index = 0; index < voices; index++)
+        {
+            channel = index % 15;
+            if (channel >= 9) channel++;
+            D77_MidiMessageShort(0x90 | channel | ((36 + 3 * (index / 15)) << 8) | (100 << 16));
+        }
+
+        // the call which starts the notes isn't measured
+        if (!D77_RenderSamples(output_buffer))
+        {
+            fprintf(stderr, "error rendering samples\n");
+            return 10;
+        }
+
+        getrusage(RUSAGE_SELF, &usage_start);
+        for (call = 0; call < num_calls; call++)
+        {
+            if (!D77_RenderSamples(output_buffer))
+            {
+                fprintf(stderr, "error rendering samples\n");
+                return 10;
+            }
+        }
+        getrusage(RUSAGE_SELF, &usage_end);
+
+        levels[level] = voices;
+        costs[level] = (get_cpu_time(&usage_end) - get_cpu_time(&usage_start)) / audio_time;
+    }
+
+    for (channel = 0; channel < 16; channel++)
+    {
+        D77_MidiMessageShort(0xb0 | channel | (120 << 8));
+    }
+
+    // linear fit: cpu time per audio second = base + voice * number of voices
+    sum_x = sum_y = sum_xx = sum_xy = 0;
+    for (level = 0; level < CALIBRATION_LEVELS; level++)
+    {
+        sum_x += levels[level];
+        sum_y += costs[level];
+        sum_xx += levels[level] * levels[level];
+        sum_xy += levels[level] * costs[level];
+    }
+
+    calibration_voice = (sum_xx * CALIBRATION_LEVELS != sum_x * sum_x) ? (sum_xy * CALIBRATION_LEVELS - sum_x * sum_y) / (sum_xx * CALIBRATION_LEVELS - sum_x * sum_x) : 0;
+    if (calibration_voice < 0) calibration_voice = 0;
+    calibration_base = (sum_y - calibration_voice * sum_x) / CALIBRATION_LEVELS;
+    if (calibration_base < 0) calibration_base = 0;
+
+    f = fopen(path, "wt");
+    if (f == NULL)
+    {
+        fprintf(stderr, "error writing calibration file\n");
+        return 12;
+    }
+
+    fprintf(f, "# d77_pcmconvert render cost calibration (cpu seconds per audio second = base + voice * number of voices)\n");
+    fprintf(f, "frequency %u\n", (unsigned int)d77_settings.dwSamplingFreq);
+    fprintf(f, "reverb %u\n", d77_settings.dwRevSw ? 1 : 0);
+    fprintf(f, "chorus %u\n", d77_settings.dwChoSw ? 1 : 0);
+    fprintf(f, "cpuload %u\n", (unsigned int)d77_settings.dwCpuLoadL);
+    fprintf(f, "base %.9f\n", calibration_base);
+    fprintf(f, "voice %.9f\n", calibration_voice);
+
+    if (fclose(f))
+    {
+        fprintf(stderr, "error writing calibration file\n");
+        return 12;
+    }
+
+    return 0;
+}
+
+static int estimate_file(const char *input_path)
+{
+    voice_estimate *est;
+    unsigned int index, num_events;
+    uint64_t end_time, interval_time;
+    double audio_time, cpu_time;
+
+    // load MIDI file
+    if (load_midi_file(input_path, &timediv, &midi_events))
+    {
+        fprintf(stderr, "error loading MIDI file\n");
+        return 4;
+    }
+
+    est = (voice_estimate *)calloc(1, sizeof(voice_estimate));
+    if (est != NULL)
+    {
+        // the synth renders up to 112 ms after the end of file
+        end_time = midi_events[0].time + 112000;
+        est->num_intervals = (unsigned int)((end_time + ESTIMATE_INTERVAL * 1000 - 1) / (ESTIMATE_INTERVAL * 1000));
+        est->interval_max = (uint16_t *)calloc(est->num_intervals, sizeof(uint16_t));
+        est->interval_sum = (double *)calloc(est->num_intervals, sizeof(double));
+    }
+    if ((est == NULL) || (est->interval_max == NULL) || (est->interval_sum == NULL))
+    {
+        if (est != NULL)
+        {
+            free(est->interval_max);
+            free(est->interval_sum);
+            free(est);
+        }
+        free_midi_data(midi_events);
+        midi_events = NULL;
+        fprintf(stderr, "error allocating memory\n");
+        return 7;
+    }
+
+    // polyphony as validated by the synth
+    est->polyphony = d77_settings.dwPolyphony;
+    if (est->polyphony < 8) est->polyphony = 8;
+    if (est->polyphony > 256) est->polyphony = 256;
+
+    // voices are simulated from the note events (without rendering), each note takes one voice
+    num_events = midi_events[0].len;
+    for (index = 1; index <= num_events; index++)
+    {
+        estimate_expire(est, midi_events[index].time);
+        estimate_event(est, midi_events + index);
+    }
+    estimate_expire(est, end_time);
+
+    audio_time = end_time / 1000000.0;
+
+    printf("{\n");
+    printf("  \"file\": ");
+    print_json_string(input_path);
+    printf(",\n");
+    printf("  \"polyphony\": %u,\n", est->polyphony);
+    printf("  \"events\": %u,\n", num_events);
+    printf("  \"notes\": %u,\n", est->num_notes);
+    printf("  \"audio_seconds\": %.6f,\n", audio_time);
+    printf("  \"peak_voices\": %u,\n", est->peak);
+    printf("  \"peak_seconds\": %.6f,\n", est->peak_time / 1000000.0);
+    printf("  \"mean_voices\": %.3f,\n", est->voice_time / (double)end_time);
+    printf("  \"voice_seconds\": %.3f,\n", est->voice_time / 1000000.0);
+    printf("  \"voices_stolen\": %u,\n", est->num_stolen);
+    if (calibration_path != NULL)
+    {
+        cpu_time = calibration_base * audio_time + calibration_voice * (est->voice_time / 1000000.0);
+        printf("  \"calibration\": { \"base\": %.9f, \"voice\": %.9f },\n", calibration_base, calibration_voice);
+        printf("  \"estimated_cpu_seconds\": %.3f,\n", cpu_time);
+        printf("  \"estimated_realtime_factor\": %.3f,\n", (cpu_time > 0) ? audio_time / cpu_time : 0.0);
+    }
+    printf("  \"interval_ms\": %u,\n", ESTIMATE_INTERVAL);
+    printf("  \"voices_max\": [");
+    for (index = 0; index < est->num_intervals; index++)
+    {
+        printf("%s%u", (index != 0) ? ", " : "", est->interval_max[index]);
+    }
+    printf("],\n");
+    printf("  \"voices_mean\": [");
+    for (index = 0; index < est->num_intervals; index++)
+    {
+        // last interval ends at the end time
+        interval_time = ((index + 1 < est->num_intervals) ? ESTIMATE_INTERVAL * 1000 : end_time - (uint64_t)index * (ESTIMATE_INTERVAL * 1000));
+        printf("%s%.1f", (index != 0) ? ", " : "", est->interval_sum[index] / interval_time);
+    }
+    printf("]\n");
+    printf("}\n");
+
+    free(est->interval_max);
+    free(est->interval_sum);
+    free(est);
+    free_midi_data(midi_events);
+    midi_events = NULL;
+
+    return 0;
+}
+
+static int render_playlist(void)
+{
+    static const int16_t zero_samples[512];
+    output_stream out;
+    char *output_path;
+    unsigned int num_files, num_failed, index, gap_samples, count;
+    uint64_t file_length, total_length;
+    double start_time, file_start_time, file_wall_time, file_cpu_time, audio_time, total_wall, total_cpu;
+    struct rusage usage_start, usage_file, usage_end;
+    int result;
+
+    if ((arg_list != NULL) && !read_batch_list(arg_list))
+    {
+        fprintf(stderr, "error reading input list\n");
+        return 11;
+    }
+
+    num_files = num_batch_inputs;
+    if (num_files == 0)
+    {
+        fprintf(stderr, "no input file\n");
+        return 11;
+    }
+
+    // files are rendered one after another by the same synth, which is reset between them
+    // without output directory the files are written to one output (gapless or with a gap of silence)
+    if (arg_outdir == NULL)
+    {
+        // cache needs a separate output for each file
+        cache_dir = NULL;
+
+        if (!output_open(&out, wav_to_file ? arg_output : NULL))
+        {
+            fprintf(stderr, "error opening output file\n");
+            return 8;
+        }
+
+        if (wav_to_file)
+        {
+            uint8_t wav_header[44];
+
+            // wav header - lengths are filled later
+            d77r_write_wav_header(wav_header, frequency, 0);
+
+            if (!output_write(&out, wav_header, 44))
+            {
+                output_close(&out);
+                fprintf(stderr, "error writing to output file\n");
+                return 9;
+            }
+        }
+
+        playlist_output = &out;
+    }
+
+    gap_samples = (unsigned int)(((uint64_t)arg_gap * frequency) / 1000) * 2;
+
+    start_time = get_time();
+    getrusage(RUSAGE_SELF, &usage_start);
+    total_length = 0;
+    num_failed = 0;
+    result = 0;
+    for (index = 0; index < num_files; index++)
+    {
+        if (index != 0)
+        {
+            d77r_reset(renderer);
+
+            // gap follows the last file written to the output
+            if ((playlist_output != NULL) && (total_length != 0) && (result == 0))
+            {
+                for (count = gap_samples; count != 0; count -= (count < 512) ? count : 512)
+                {
+                    if (!output_write(&out, zero_samples, ((count < 512) ? count : 512) * sizeof(int16_t))) break;
+                }
+                if (count != 0)
+                {
+                    fprintf(stderr, "error writing to output file\n");
+                    result = 9;
+                    num_failed++;
+                    break;
+                }
+                total_length += gap_samples * sizeof(int16_t);
+            }
+        }
+
+        output_path = NULL;
+        if (arg_outdir != NULL)
+        {
+            output_path = get_output_path(batch_inputs[index]);
+            if (output_path == NULL)
+            {
+                result = 11;
+                num_failed++;
+                fprintf(stderr, "[%u/%u] %s: error %i\n", index + 1, num_files, batch_inputs[index], result);
+                continue;
+            }
+        }
+
+        file_start_time = get_time();
+        getrusage(RUSAGE_SELF, &usage_file);
+        playlist_length = 0;
+
+        result = render_file(batch_inputs[index], output_path);
+
+        file_wall_time = get_time() - file_start_time;
+        getrusage(RUSAGE_SELF, &usage_end);
+        file_cpu_time = get_cpu_time(&usage_end) - get_cpu_time(&usage_file);
+        file_length = playlist_length;
+        total_length += file_length;
+
+        if (result)
+        {
+            num_failed++;
+            fprintf(stderr, "[%u/%u] %s: error %i\n", index + 1, num_files, batch_inputs[index], result);
+        }
+        else
+        {
+            audio_time = (file_length / (2 * sizeof(int16_t))) / (double)frequency;
+            fprintf(stderr, "[%u/%u] %s%s%s: %.2f s audio, %.2f s wall, %.2f s cpu, %.1fx realtime\n", index + 1, num_files, batch_inputs[index], (output_path != NULL) ? " -> " : "", (output_path != NULL) ? output_path : "", audio_time, file_wall_time, file_cpu_time, (file_wall_time > 0) ? audio_time / file_wall_time : 0.0);
+        }
+
+        free(output_path);
+
+        // the file could be partially written to the shared output
+        if (result && (playlist_output != NULL) && (file_length != 0)) break;
+    }
+    if (index >= num_files) result = 0;
+
+    if (playlist_output != NULL)
+    {
+        playlist_output = NULL;
+
+        if (!output_flush(&out) && (result == 0))
+        {
+            fprintf(stderr, "error writing to output file\n");
+            result = 9;
+        }
+
+        if (wav_to_file && (result == 0))
+        {
+            uint8_t chunk_length[4];
+
+            // RIFF length, data chunk length
+            WRITE_LE_UINT32(chunk_length, (uint32_t)(36 + total_length));
+            if (!output_rewrite(&out, 4, chunk_length, 4)) result = 9;
+
+            WRITE_LE_UINT32(chunk_length, (uint32_t)total_length);
+            if (!output_rewrite(&out, 40, chunk_length, 4)) result = 9;
+
+            if (result) fprintf(stderr, "error writing to output file\n");
+        }
+
+        if (!output_close(&out) && (result == 0))
+        {
+            fprintf(stderr, "error writing to output file\n");
+            result = 9;
+        }
+    }
+
+    total_wall = get_time() - start_time;
+    getrusage(RUSAGE_SELF, &usage_end);
+    total_cpu = get_cpu_time(&usage_end) - get_cpu_time(&usage_start);
+    audio_time = (total_length / (2 * sizeof(int16_t))) / (double)frequency;
+
+    fprintf(stderr, "%u files, %u failed: %.2f s audio, %.2f s wall, %.2f s cpu, %.1fx realtime, %.2f files/s\n", num_files, num_failed, audio_time, total_wall, total_cpu, (total_wall > 0) ? audio_time / total_wall : 0.0, (total_wall > 0) ? (num_files - num_failed) / total_wall : 0.0);
+
+    if (result) return result;
+    return num_failed ? 11 : 0;
+}
+#endif
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "d77_pcmconvert";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+
+#ifdef _WIN32
+        slash = strrchr(progname, '\\');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+#endif
+    }
+
+    printf(
+        "%s - WebSynth D-77 pcm convert\n"
+        "Usage: %s [OPTIONS]...\n"
+#ifdef _WIN32
+        "  -i PATH  Input path (path to .mid, - = standard input)\n"
+#else
+        "  -i PATH  Input path (path to .mid, - = standard input, repeat for batch mode)\n"
+#endif
+        "  -s       Output raw data do stdout\n"
+        "  -o PATH  Output path (path to .wav)\n"
+#ifndef _WIN32
+        "  -I PATH  Input list for batch mode (one path to .mid per line)\n"
+        "  -d PATH  Output directory for batch mode (or template, %%s = input name)\n"
+        "  -j NUM   Number of parallel jobs in batch mode (default: number of cpus)\n"
+#endif
+        "  -w PATH  Datafile path (path to dsweb*.dat)\n"
+#ifdef INDIRECT_64BIT
+#if defined(EMBEDDED_LIBRARY)
+        "  -b PATH  Library path (default: embedded library)\n"
+#elif defined(_WIN32)
+        "  -b PATH  Library path (path to d77_lib.dll)\n"
+#else
+        "  -b PATH  Library path (path to d77_lib.so)\n"
+#endif
+#endif
+        "  -f NUM   Frequency (22050/44100 Hz)\n"
+        "  -p NUM   Polyphony (8-256)\n"
+        "  -m NUM   Master volume (0-200)\n"
+        "  -r NUM   Reverb effect (0=off, 1=on)\n"
+        "  -c NUM   Chorus effect (0=off, 1=on)\n"
+        "  -l NUM   Cpu load (20-85)\n"
+        "  -h       Help\n"
+#if !defined(_WIN32) && defined(O_DIRECT)
+        "  --direct Write output file using direct I/O (O_DIRECT)\n"
+#endif
+        "  --start SEC      Start rendering at given time (state is chased up to the pre-roll)\n"
+        "  --end SEC        Stop rendering at given time\n"
+        "  --preroll MS     Pre-roll before start / segments (default: 3000 ms)\n"
+        "  --stats          Print render statistics (render time, time to first sample)\n"
+        "  --tail           End when the sound ends (instead of 112 ms after the end of file)\n"
+        "                   and trim trailing silence\n"
+        "  --tail-window MS     Length of quiet output which ends the tail (default: 1000 ms)\n"
+        "  --tail-threshold NUM Peak level of quiet output (default: 8)\n"
+        "  --tail-max MS        Maximum length of the tail after the last event (default: 15000 ms)\n"
+        "  --optimize       Drop redundant events (repeated or overwritten controllers, pitch wheel, ...)\n"
+#ifndef _WIN32
+        "Playlist (files from -i / -I are rendered one after another, the synth is reset between them):\n"
+        "  --playlist       Render the files to one output (-o / -s) or to output directory (-d)\n"
+        "  --gap MS         Silence between the files in one output (default: 0 = gapless)\n"
+        "Segment-parallel rendering:\n"
+        "  --segments NUM   Render NUM segments of the file in parallel (-j sets parallel processes)\n"
+        "  --crossfade MS   Crossfade between segments (default: 20 ms)\n"
+        "  --validate       With --segments: compare with serial rendering and print the deviation (at the seams),\n"
+        "                   with --optimize: compare with rendering of the original events, exit code 13 when different\n"
+        "Benchmark:\n"
+        "  --bench          Render to null sink and print timing statistics (JSON)\n"
+        "  --bench-parse TRACKS:EVENTS  Parse synthetic MIDI file (EVENTS per track) and print parsing speed (JSON)\n"
+        "Render cost estimate:\n"
+        "  --estimate       Simulate voices (without rendering) and print voice count over time, peak polyphony,\n"
+        "                   voice-seconds and estimated cpu time (JSON)\n"
+        "  --calibration FILE  Render cost calibration for the cpu time estimate\n"
+        "                      (measured on this host when FILE is missing or was measured with other settings)\n"
+        "Render cache:\n"
+        "  --cache DIR      Store rendered files in cache directory and reuse them (not used with -s)\n"
+        "  --cache-size MB  Maximum size of cache directory (default: 1024 MB)\n"
+        "  --cache-hardlink Hardlink output files to (read-only) cache entries instead of copying\n"
+        "Settings sweep (output files are written to output directory, -j sets parallel jobs):\n"
+        "  --sweep NAME=VALUES  Render with each value of parameter (e.g. RevAdj=60,80,100 or Polyphony=32:128:32),\n"
+        "                       multiple sweeps are combined into a grid\n"
+        "  --sweep-file FILE    Render each configuration from file (NAME=VALUE ... per line)\n"
+        "                   Parameters: Freq, Polyphony, CpuLoad, MVol, RevSw, ChoSw, RevAdj, ChoAdj,\n"
+        "                               OutLev, RevFb, RevDrm, ResoUpAdj\n"
+#endif
+        "Advanced parameters:\n"
+        "  -aRevAdj NUM     (0-200)\n"
+        "  -aChoAdj NUM     (0-200)\n"
+        "  -aOutLev NUM     (0-200)\n"
+        "  -aRevFb NUM      (0-200)\n"
+        "  -aRevDrm NUM     (0-200)\n"
+        "  -aResoUpAdj NUM  (0-100)\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    d77r_settings render_settings;
+    int return_value;
+
+    // default settings from .ini file
+    d77r_default_settings(&render_settings);
+    d77_settings = render_settings.synth;
+
+    // parse arguments
+    if (argc > 1)
+    {
+        int i, j;
+        for (i = 1; i < argc; i++)
+        {
+            if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+            {
+                switch (argv[i][1])
+                {
+                    case 'i': // input
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+#ifdef _WIN32
+                            arg_input = argv[i];
+#else
+                            if (!add_batch_input(argv[i]))
+                            {
+                                fprintf(stderr, "error allocating memory\n");
+                                return 2;
+                            }
+#endif
+                        }
+                        break;
+#ifndef _WIN32
+                    case 'I': // input list
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            arg_list = argv[i];
+                        }
+                        break;
+                    case 'd': // output directory
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            arg_outdir = argv[i];
+                        }
+                        break;
+                    case 'j': // parallel jobs
+                        if ((i + 1) < argc)
+                        {
+                            i++;
+                            j = atoi(argv[i]);
+                            if (j >= 1)
+                            {
+                                arg_jobs = j;
+                            }
                         }
                         break;
+#endif
                     case 'o': // output
                         if ((i + 1) < argc)
                         {
@@ -469,67 +4240,262 @@ int main(int argc, char *argv[])
                         }
                     }
                 }
-                else if (0 == strcmp(argv[i] + 2, "ChoAdj"))
+                else if (0 == strcmp(argv[i] + 2, "ChoAdj"))
+                {
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 200)
+                        {
+                            d77_settings.dwChoAdj = j;
+                        }
+                    }
+                }
+                else if (0 == strcmp(argv[i] + 2, "OutLev"))
+                {
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 200)
+                        {
+                            d77_settings.dwOutLev = j;
+                        }
+                    }
+                }
+                else if (0 == strcmp(argv[i] + 2, "RevFb"))
+                {
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 200)
+                        {
+                            d77_settings.dwRevFb = j;
+                        }
+                    }
+                }
+                else if (0 == strcmp(argv[i] + 2, "RevDrm"))
+                {
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 200)
+                        {
+                            d77_settings.dwRevDrm = j;
+                        }
+                    }
+                }
+                else if (0 == strcmp(argv[i] + 2, "ResoUpAdj"))
+                {
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 100)
+                        {
+                            d77_settings.dwResoUpAdj = j;
+                        }
+                    }
+                }
+            }
+            else if (strcmp(argv[i], "--direct") == 0)
+            {
+                direct_output = 1;
+            }
+            else if ((strcmp(argv[i], "--start") == 0) || (strcmp(argv[i], "--end") == 0))
+            {
+                if ((i + 1) < argc)
+                {
+                    double seconds;
+
+                    seconds = atof(argv[i + 1]);
+                    if (seconds >= 0 && seconds < 4000000)
+                    {
+                        if (argv[i][2] == 's')
+                        {
+                            arg_start = (uint32_t)(seconds * 1000);
+                        }
+                        else
+                        {
+                            arg_end = (uint32_t)(seconds * 1000);
+                        }
+                    }
+                    i++;
+                }
+            }
+            else if (strcmp(argv[i], "--preroll") == 0)
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0)
+                    {
+                        arg_preroll = j;
+                    }
+                }
+            }
+            else if (strcmp(argv[i], "--stats") == 0)
+            {
+                print_stats = 1;
+            }
+            else if (strcmp(argv[i], "--optimize") == 0)
+            {
+                optimize_mode = 1;
+            }
+            else if (strcmp(argv[i], "--tail") == 0)
+            {
+                tail_mode = 1;
+            }
+            else if ((strcmp(argv[i], "--tail-window") == 0) || (strcmp(argv[i], "--tail-max") == 0) || (strcmp(argv[i], "--tail-threshold") == 0))
+            {
+                if ((i + 1) < argc)
+                {
+                    j = atoi(argv[i + 1]);
+                    if (j >= 0)
+                    {
+                        tail_mode = 1;
+                        if (argv[i][7] == 'w')
+                        {
+                            arg_tail_window = j;
+                        }
+                        else if (argv[i][7] == 'm')
+                        {
+                            arg_tail_max = j;
+                        }
+                        else if (j <= 32767)
+                        {
+                            arg_tail_threshold = j;
+                        }
+                    }
+                    i++;
+                }
+            }
+#ifndef _WIN32
+            else if (strcmp(argv[i], "--playlist") == 0)
+            {
+                playlist_mode = 1;
+            }
+            else if (strcmp(argv[i], "--gap") == 0)
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0)
+                    {
+                        arg_gap = j;
+                    }
+                }
+            }
+            else if (strcmp(argv[i], "--segments") == 0)
+            {
+                if ((i + 1) < argc)
                 {
-                    if ((i + 1) < argc)
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 1)
                     {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 200)
-                        {
-                            d77_settings.dwChoAdj = j;
-                        }
+                        arg_segments = j;
                     }
                 }
-                else if (0 == strcmp(argv[i] + 2, "OutLev"))
+            }
+            else if (strcmp(argv[i], "--crossfade") == 0)
+            {
+                if ((i + 1) < argc)
                 {
-                    if ((i + 1) < argc)
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0)
                     {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 200)
-                        {
-                            d77_settings.dwOutLev = j;
-                        }
+                        arg_crossfade = j;
                     }
                 }
-                else if (0 == strcmp(argv[i] + 2, "RevFb"))
+            }
+            else if (strcmp(argv[i], "--validate") == 0)
+            {
+                validate_mode = 1;
+            }
+            else if (strcmp(argv[i], "--bench") == 0)
+            {
+                bench_mode = 1;
+            }
+            else if (strcmp(argv[i], "--bench-parse") == 0)
+            {
+                if ((i + 1) < argc)
                 {
-                    if ((i + 1) < argc)
+                    unsigned int tracks, events;
+
+                    i++;
+                    if ((sscanf(argv[i], "%u:%u", &tracks, &events) == 2) && (tracks >= 1) && (tracks <= 65535) && (events >= 1) && (events <= 100000000))
                     {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 200)
-                        {
-                            d77_settings.dwRevFb = j;
-                        }
+                        bench_parse_tracks = tracks;
+                        bench_parse_events = events;
                     }
                 }
-                else if (0 == strcmp(argv[i] + 2, "RevDrm"))
+            }
+            else if (strcmp(argv[i], "--estimate") == 0)
+            {
+                estimate_mode = 1;
+            }
+            else if (strcmp(argv[i], "--calibration") == 0)
+            {
+                if ((i + 1) < argc)
                 {
-                    if ((i + 1) < argc)
+                    i++;
+                    calibration_path = argv[i];
+                }
+            }
+            else if (strcmp(argv[i], "--cache") == 0)
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    cache_dir = argv[i];
+                }
+            }
+            else if (strcmp(argv[i], "--cache-size") == 0)
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 1)
                     {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 200)
-                        {
-                            d77_settings.dwRevDrm = j;
-                        }
+                        cache_size = (uint64_t)j * 1024 * 1024;
                     }
                 }
-                else if (0 == strcmp(argv[i] + 2, "ResoUpAdj"))
+            }
+            else if (strcmp(argv[i], "--cache-hardlink") == 0)
+            {
+                cache_hardlink = 1;
+            }
+            else if (strcmp(argv[i], "--sweep") == 0)
+            {
+                if ((i + 1) < argc)
                 {
-                    if ((i + 1) < argc)
+                    i++;
+                    if (!add_sweep_dimension(argv[i]))
                     {
-                        i++;
-                        j = atoi(argv[i]);
-                        if (j >= 0 && j <= 100)
-                        {
-                            d77_settings.dwResoUpAdj = j;
-                        }
+                        fprintf(stderr, "invalid sweep: %s\n", argv[i]);
+                        usage(argv[0]);
                     }
+                    sweep_mode = 1;
+                }
+            }
+            else if (strcmp(argv[i], "--sweep-file") == 0)
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    arg_sweep_file = argv[i];
+                    sweep_mode = 1;
                 }
             }
+#endif
             else if (strcmp(argv[i], "--help") == 0)
             {
                 usage(argv[0]);
@@ -537,318 +4503,217 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (arg_input == NULL)
+#ifndef _WIN32
+    // parser benchmark doesn't use the synth
+    if (bench_parse_tracks != 0)
     {
-        fprintf(stderr, "no input file\n");
-        usage(argv[0]);
+        return bench_parse(bench_parse_tracks, bench_parse_events);
     }
-    if (wav_to_file && arg_output == NULL)
+
+    if (sweep_mode)
     {
-        fprintf(stderr, "no output file\n");
-        usage(argv[0]);
+        if ((num_batch_inputs != 1) || (arg_list != NULL))
+        {
+            fprintf(stderr, "sweep requires one input file\n");
+            usage(argv[0]);
+        }
+        if (arg_outdir == NULL)
+        {
+            fprintf(stderr, "no output directory\n");
+            usage(argv[0]);
+        }
+        arg_input = batch_inputs[0];
     }
-
-#ifdef INDIRECT_64BIT
-    // load library
-    if (!D77_LoadLibrary(arg_lib))
+    else if (playlist_mode)
     {
-        fprintf(stderr, "error loading library\n");
-        return 1;
+        if ((num_batch_inputs == 0) && (arg_list == NULL))
+        {
+            fprintf(stderr, "no input file\n");
+            usage(argv[0]);
+        }
+        if (wav_to_file && (arg_output == NULL) && (arg_outdir == NULL))
+        {
+            fprintf(stderr, "no output file\n");
+            usage(argv[0]);
+        }
     }
-#endif
+    // -j sets the number of parallel segments with --segments
+    else if ((num_batch_inputs > 1) || (arg_list != NULL) || ((arg_jobs != 0) && (arg_segments == 0)) || (arg_outdir != NULL))
+    {
+        unsigned int index;
 
-#ifdef PTROFS_64BIT
-    if (!D77_InitializePointerOffset())
+        if (arg_outdir == NULL)
+        {
+            fprintf(stderr, "no output directory\n");
+            usage(argv[0]);
+        }
+        for (index = 0; index < num_batch_inputs; index++)
+        {
+            if (strcmp(batch_inputs[index], "-") == 0)
+            {
+                fprintf(stderr, "standard input can't be used in batch mode\n");
+                usage(argv[0]);
+            }
+        }
+        batch_mode = 1;
+    }
+    else
     {
-        fprintf(stderr, "error initializing pointer offset\n");
-        return 1;
+        arg_input = (num_batch_inputs != 0) ? batch_inputs[0] : NULL;
     }
-#endif
 
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-    input_buffer = (uint8_t *)D77_AllocateMemory(65536);
-    if (input_buffer == NULL)
+    if (estimate_mode && (batch_mode || sweep_mode || playlist_mode))
     {
-        fprintf(stderr, "error allocating input buffer\n");
-        return 2;
+        fprintf(stderr, "estimate requires one input file\n");
+        usage(argv[0]);
     }
-#endif
 
-    // load DATA file
-    datafile_ptr = load_data_file(arg_data, &datafile_len);
-    if (datafile_ptr == NULL)
+    if ((arg_segments != 0) && ((arg_start != 0) || (arg_end != 0) || tail_mode))
     {
-        fprintf(stderr, "error loading DATA file\n");
-        return 3;
+        fprintf(stderr, "segments can't be used with start, end or tail\n");
+        usage(argv[0]);
     }
 
-    // load MIDI file
-    if (load_midi_file(arg_input, &timediv, &midi_events))
+    // the reference render is compared with each file separately
+    if (validate_mode && (((arg_segments == 0) && !optimize_mode) || (playlist_mode && (arg_outdir == NULL))))
     {
-        fprintf(stderr, "error loading MIDI file\n");
-        return 4;
+        fprintf(stderr, "validate requires segments or optimize (and output directory in playlist)\n");
+        usage(argv[0]);
     }
 
-
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-    memcpy(input_buffer, &d77_settings, sizeof(D77_SETINGS));
-    D77_ValidateSettings((D77_SETINGS *)input_buffer);
-    memcpy(&d77_settings, input_buffer, sizeof(D77_SETINGS));
-#else
-    D77_ValidateSettings(&d77_settings);
+    if (!batch_mode && !sweep_mode && !playlist_mode)
 #endif
-
-    if (!D77_InitializeDataFile(datafile_ptr, datafile_len - 4))
     {
-        fprintf(stderr, "error initializing DATA file\n");
-        return 5;
+        if (arg_input == NULL)
+        {
+            fprintf(stderr, "no input file\n");
+            usage(argv[0]);
+        }
+#ifndef _WIN32
+        if (wav_to_file && arg_output == NULL && !bench_mode && !estimate_mode)
+#else
+        if (wav_to_file && arg_output == NULL)
+#endif
+        {
+            fprintf(stderr, "no output file\n");
+            usage(argv[0]);
+        }
     }
 
-    if (!D77_InitializeSynth(d77_settings.dwSamplingFreq, d77_settings.dwPolyphony, d77_settings.dwTimeReso))
+#ifndef _WIN32
+    // the synth is needed only to measure the calibration of the estimate
+    if (estimate_mode && ((calibration_path == NULL) || read_calibration(calibration_path)))
     {
-        fprintf(stderr, "error initializing synth\n");
-        return 6;
+        return estimate_file(arg_input);
     }
 
-    D77_InitializeUnknown(0);
-    D77_InitializeEffect(D77_EFFECT_Reverb, d77_settings.dwRevSw ? 1 : 0);
-    D77_InitializeEffect(D77_EFFECT_Chorus, d77_settings.dwChoSw ? 1 : 0);
-    D77_InitializeCpuLoad(d77_settings.dwCpuLoadL, d77_settings.dwCpuLoadH);
-
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-    d77_parameters = (D77_PARAMETERS *)input_buffer;
-#else
-    d77_parameters = &d77_param_buffer;
+    startup_time = get_raw_time();
 #endif
-    d77_parameters->wChoAdj = d77_settings.dwChoAdj;
-    d77_parameters->wRevAdj = d77_settings.dwRevAdj;
-    d77_parameters->wRevDrm = d77_settings.dwRevDrm;
-    d77_parameters->wRevFb = d77_settings.dwRevFb;
-    d77_parameters->wOutLev = d77_settings.dwOutLev;
-    d77_parameters->wResoUpAdj = d77_settings.dwResoUpAdj;
-
-    D77_InitializeParameters(d77_parameters);
-
-    D77_InitializeMasterVolume(d77_settings.dwMVol);
 
-    frequency = d77_settings.dwSamplingFreq;
-    samples_per_call = D77_GetRenderedSamplesPerCall();
-    bytes_per_call = samples_per_call * 2 * sizeof(int16_t);
+    // load library and DATA file
+    render_settings.datafile = arg_data;
+#ifdef INDIRECT_64BIT
+    render_settings.library = arg_lib;
+#endif
+    render_settings.synth = d77_settings;
 
-    // allocate output buffer
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-    output_buffer = (int16_t *)D77_AllocateMemory(bytes_per_call);
+    return_value = d77r_load(&render_settings, &renderer);
+    switch (return_value)
+    {
+        case 0:
+            break;
+        case D77R_ERROR_LIBRARY:
+#ifdef INDIRECT_64BIT
+            fprintf(stderr, "error loading library\n");
 #else
-    output_buffer = (int16_t *)malloc(bytes_per_call);
+            fprintf(stderr, "error initializing pointer offset\n");
 #endif
-    if (output_buffer == NULL)
-    {
-        fprintf(stderr, "error allocating output buffer\n");
-        return 7;
+            return return_value;
+        case D77R_ERROR_BUFFER:
+            fprintf(stderr, "error allocating input buffer\n");
+            return return_value;
+        case D77R_ERROR_DATAFILE:
+            fprintf(stderr, "error loading DATA file\n");
+            return return_value;
+        default:
+            fprintf(stderr, "error allocating memory\n");
+            return return_value;
     }
 
-
-    return_value = 0;
-
-
-    current_time = 0;
-
-    // play midi
+#ifndef _WIN32
+    if (cache_dir != NULL)
     {
-        unsigned int num_calls, remaining_events;
-        midi_event_info *cur_event;
-
-        FILE *fout;
+        const uint8_t *datafile;
+        unsigned int datafile_len;
 
-        if (wav_to_file)
-        {
-            uint8_t wav_header[44];
-            uint8_t *header_ptr;
+        // the synth replaces offsets in the datafile header with pointers (which differ between runs),
+        // so the datafile is hashed before the synth is initialized
+        datafile = d77r_get_datafile(renderer, &datafile_len);
+        datafile_hash = get_hash(UINT64_C(0xcbf29ce484222325), datafile, datafile_len);
+    }
 
-#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
-            if (fopen_s(&fout, arg_output, "wb"))
-#else
-            fout = fopen(arg_output, "wb");
-            if (fout == NULL)
-#endif
-            {
-                free_midi_data(midi_events);
-                fprintf(stderr, "error opening output file\n");
-                return 8;
-            }
-
-            // wav header
-            header_ptr = wav_header;
-            WRITE_LE_UINT32(header_ptr, 0x46464952);        // "RIFF" tag
-            WRITE_LE_UINT32(header_ptr + 4, 36);            // RIFF length - filled later
-            WRITE_LE_UINT32(header_ptr + 8, 0x45564157);    // "WAVE" tag
-            header_ptr += 12;
-
-            // fmt chunk
-            WRITE_LE_UINT32(header_ptr, 0x20746D66);    // "fmt " tag
-            WRITE_LE_UINT32(header_ptr + 4, 16);        // chunk length
-            header_ptr += 8;
-
-            // PCMWAVEFORMAT structure
-            WRITE_LE_UINT16(header_ptr, 1);                 // wFormatTag - 1 = PCM
-            WRITE_LE_UINT16(header_ptr + 2, 2);             // nChannels - 2 = stereo
-            WRITE_LE_UINT32(header_ptr + 4, frequency);     // nSamplesPerSec
-            WRITE_LE_UINT32(header_ptr + 8, 4 * frequency); // nAvgBytesPerSec
-            WRITE_LE_UINT16(header_ptr + 12, 4);            // nBlockAlign
-            WRITE_LE_UINT16(header_ptr + 14, 16);           // wBitsPerSample
-            header_ptr += 16;
-
-            // data chunk
-            WRITE_LE_UINT32(header_ptr, 0x61746164);    // "data" tag
-            WRITE_LE_UINT32(header_ptr + 4, 0);         // chunk length - filled later
-            header_ptr += 8;
-
-            if (fwrite(wav_header, 1, 44, fout) != 44)
-            {
-                fprintf(stderr, "error writing to output file\n");
-                return 9;
-            }
-        }
-        else
-        {
-#ifdef _WIN32
-            if (_setmode(_fileno(stdout), _O_BINARY) == -1)
-            {
-                fprintf(stderr, "error changing output mode to binary\n");
-                return 9;
-            }
+    // in sweep mode each worker process initializes the synth with its own settings
+    if (!sweep_mode)
 #endif
-            fout = stdout;
-        }
+    {
+        return_value = initialize_synth();
+        if (return_value) return return_value;
+    }
 
-        num_calls = 0;
-        remaining_events = midi_events[0].len;
-        cur_event = midi_events + 1;
-        while (current_time < midi_events[0].time + 112)
-        {
-            uint32_t next_time;
+#ifndef _WIN32
+    startup_time = get_raw_time() - startup_time;
 
-            num_calls++;
+    if (cache_dir != NULL)
+    {
+        const char *library_path;
 
-            next_time = ((num_calls * samples_per_call + (samples_per_call >> 1)) * (uint64_t)1000) / frequency;
-            while ((remaining_events > 0) && (cur_event->time <= next_time))
-            {
-                if (cur_event->len <= 8)
-                {
-                    if (cur_event->data[0] != 0xff) // skip meta events
-                    {
-                        if (cur_event->data[0] == 0xf0)
-                        {
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-                            memcpy(input_buffer, cur_event->data, cur_event->len);
-                            D77_MidiMessageLong(input_buffer, cur_event->len);
-#else
-                            D77_MidiMessageLong(cur_event->data, cur_event->len);
-#endif
-                        }
-                        else
-                        {
-                            D77_MidiMessageShort(cur_event->data[0] | (cur_event->data[1] << 8) | (cur_event->data[2] << 16));
-                        }
-                    }
-                }
-                else
-                {
-                    if (cur_event->sysex[0] != 0xff) // skip meta events
-                    {
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-                        if (cur_event->len <= 65536)
-                        {
-                            memcpy(input_buffer, cur_event->sysex, cur_event->len);
-                            D77_MidiMessageLong(input_buffer, cur_event->len);
-                        }
+        // the statically linked synth is part of the executable
+#ifdef INDIRECT_64BIT
+        library_path = (arg_lib != NULL) ? arg_lib : get_executable_path();
 #else
-                        D77_MidiMessageLong(cur_event->sysex, cur_event->len);
-#endif
-                    }
-                }
-
-                cur_event++;
-                remaining_events--;
-            }
-
-            current_time = next_time;
-
-            if (!D77_RenderSamples(output_buffer))
-            {
-                fprintf(stderr, "error rendering samples\n");
-                return_value = 10;
-                break;
-            }
-
-
-#ifdef BIG_ENDIAN_BYTE_ORDER
-            // swap values to little-endian
-            {
-                int i;
-                for (i = 0; i < bytes_per_call; i += 2)
-                {
-                    uint8_t value;
-                    value = output_buffer[i];
-                    output_buffer[i] = output_buffer[i + 1];
-                    output_buffer[i + 1] = value;
-                }
-            }
+        library_path = get_executable_path();
 #endif
-
-            if (fwrite(output_buffer, 1, bytes_per_call, fout) != bytes_per_call)
-            {
-                fprintf(stderr, "error writing to output file\n");
-                return_value = 9;
-                break;
-            }
-        }
-
-        if (wav_to_file)
-        {
-            uint8_t chunk_length[4];
-
-            // RIFF length
-            WRITE_LE_UINT32(chunk_length, 36 + num_calls * bytes_per_call);
-            fseek(fout, 4, SEEK_SET);
-            if (fwrite(chunk_length, 4, 1, fout) != 1)
-            {
-                fprintf(stderr, "error writing to output file\n");
-                return 9;
-            }
-
-            // data chunk length
-            WRITE_LE_UINT32(chunk_length, num_calls * bytes_per_call);
-            fseek(fout, 40, SEEK_SET);
-            if (fwrite(chunk_length, 4, 1, fout) != 1)
-            {
-                fprintf(stderr, "error writing to output file\n");
-                return 9;
-            }
-
-            fclose(fout);
-        }
-        else
+        mkdir(cache_dir, 0777);
+        if ((library_path == NULL) || !get_library_hash(library_path, &library_hash))
         {
-            fflush(fout);
-            fout = NULL;
+            fprintf(stderr, "error reading library, cache disabled\n");
+            cache_dir = NULL;
         }
     }
 
-    // free output buffer, MIDI file, DATA file
-#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
-    D77_FreeMemory(output_buffer, bytes_per_call);
-    D77_FreeMemory(datafile_ptr, datafile_len);
-    D77_FreeMemory(input_buffer, 65536);
-#ifdef INDIRECT_64BIT
-    D77_FreeLibrary();
-#endif
-#else
-    free(output_buffer);
-    free(datafile_ptr);
+    if (sweep_mode)
+    {
+        return_value = convert_sweep();
+    }
+    else if (batch_mode)
+    {
+        return_value = convert_batch();
+    }
+    else if (playlist_mode)
+    {
+        return_value = render_playlist();
+    }
+    else if (estimate_mode)
+    {
+        return_value = measure_calibration(calibration_path);
+        if (!return_value) return_value = estimate_file(arg_input);
+    }
+    else if (bench_mode)
+    {
+        return_value = bench_file(arg_input);
+    }
+    else if (arg_segments != 0)
+    {
+        return_value = render_segments(arg_input, wav_to_file ? arg_output : NULL);
+    }
+    else
 #endif
-    free_midi_data(midi_events);
+    {
+        return_value = render_file(arg_input, wav_to_file ? arg_output : NULL);
+    }
+
+    // free output buffer, DATA file, library
+    d77r_close(renderer);
 
     return return_value;
 }
-
@@ -0,0 +1,649 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _FILE_OFFSET_BITS 64
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "midi_loader.h"
+#include "d77_render.h"
+
+#if (defined(__WIN32__) || defined(__WINDOWS__)) && !defined(_WIN32)
+#define _WIN32
+#endif
+
+#ifndef _WIN32
+    #include <dirent.h>
+    #include <strings.h>
+#endif
+
+#if defined(__GNUC__)
+#define INLINE __inline__
+#elif defined(_MSC_VER)
+#define INLINE __inline
+#else
+#define INLINE inline
+#endif
+
+// maximum length of silence rendered (in ms) after reset, to let the effects decay
+#define RESET_DECAY_TIME 3000
+
+struct d77r_renderer_
+{
+    D77_SETINGS settings;
+    D77_PARAMETERS *parameters;
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    uint8_t *input_buffer;
+#else
+    D77_PARAMETERS param_buffer;
+#endif
+    uint8_t *datafile;
+    int datafile_len;
+    int16_t *output_buffer;
+    unsigned int frequency, samples_per_call, bytes_per_call;
+};
+
+static int renderer_open = 0;
+
+
+static INLINE void WRITE_LE_UINT16(uint8_t *ptr, uint16_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+}
+
+static INLINE void WRITE_LE_UINT32(uint8_t *ptr, uint32_t value)
+{
+    ptr[0] = value & 0xff;
+    ptr[1] = (value >> 8) & 0xff;
+    ptr[2] = (value >> 16) & 0xff;
+    ptr[3] = (value >> 24) & 0xff;
+}
+
+
+void d77r_default_settings(d77r_settings *settings)
+{
+    memset(settings, 0, sizeof(d77r_settings));
+
+    settings->datafile = "dswebWDM.dat";
+#if defined(INDIRECT_64BIT) && !defined(EMBEDDED_LIBRARY)
+#if defined(_WIN32)
+    settings->library = "d77_lib.dll";
+#else
+    settings->library = "d77_lib.so";
+#endif
+#else
+    settings->library = NULL; // embedded or statically linked library
+#endif
+
+    // default settings from .ini file
+    settings->synth.dwSamplingFreq = 44100;
+    settings->synth.dwPolyphony = 64;
+    settings->synth.dwCpuLoadL = 60;
+    settings->synth.dwCpuLoadH = 90;
+    settings->synth.dwRevSw = 1;
+    settings->synth.dwChoSw = 1;
+    settings->synth.dwMVol = 100;
+    settings->synth.dwRevAdj = 95;
+    settings->synth.dwChoAdj = 70;
+    settings->synth.dwOutLev = 110;
+    settings->synth.dwRevFb = 95;
+    settings->synth.dwRevDrm = 80;
+    settings->synth.dwResoUpAdj = 40;
+    settings->synth.dwCacheSize = 3;
+    settings->synth.dwTimeReso = 80;
+}
+
+uint8_t *d77r_load_datafile(const char *datapath, int *length)
+{
+    FILE *f;
+    uint8_t *mem;
+    long datalen;
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&f, datapath, "rb"))
+#else
+    f = fopen(datapath, "rb");
+#endif
+    if (f == NULL)
+    {
+#ifndef _WIN32
+        char *pathcopy, *slash, *filename;
+        DIR *dir;
+        struct dirent *entry;
+
+        pathcopy = strdup(datapath);
+        if (pathcopy == NULL) return NULL;
+
+        slash = strrchr(pathcopy, '/');
+        if (slash != NULL)
+        {
+            filename = slash + 1;
+            if (slash != pathcopy)
+            {
+                *slash = 0;
+                dir = opendir(pathcopy);
+                *slash = '/';
+            }
+            else
+            {
+                dir = opendir("/");
+            }
+        }
+        else
+        {
+            filename = pathcopy;
+            dir = opendir(".");
+        }
+
+        if (dir == NULL)
+        {
+            free(pathcopy);
+            return NULL;
+        }
+
+        while (1)
+        {
+            entry = readdir(dir);
+            if (entry == NULL) break;
+
+            if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_REG && entry->d_type != DT_LNK) continue;
+
+            if (0 != strcasecmp(filename, entry->d_name)) continue;
+
+            strcpy(filename, entry->d_name);
+            break;
+        };
+
+        closedir(dir);
+
+        if (entry == NULL)
+        {
+            free(pathcopy);
+            return NULL;
+        }
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+        if (fopen_s(&f, pathcopy, "rb"))
+#else
+        f = fopen(pathcopy, "rb");
+        if (f == NULL)
+#endif
+        {
+            free(pathcopy);
+            return NULL;
+        }
+
+        free(pathcopy);
+#else
+        return NULL;
+#endif
+    }
+
+    if (fseek(f, 0, SEEK_END))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    datalen = ftell(f);
+    if (datalen <= 4)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fseek(f, 0, SEEK_SET))
+    {
+        fclose(f);
+        return NULL;
+    }
+
+
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    mem = (uint8_t *)D77_AllocateMemory(datalen);
+#else
+    mem = (uint8_t *)malloc(datalen);
+#endif
+    if (mem == NULL)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    if (fread(mem, 1, datalen, f) != (unsigned long)datalen)
+    {
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+        D77_FreeMemory(mem, datalen);
+#else
+        free(mem);
+#endif
+        fclose(f);
+        return NULL;
+    }
+
+    if (length != NULL)
+    {
+        *length = datalen;
+    }
+
+    return mem;
+}
+
+void d77r_free_datafile(uint8_t *data, int length)
+{
+    if (data == NULL) return;
+
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    D77_FreeMemory(data, length);
+#else
+    free(data);
+#endif
+}
+
+void d77r_write_wav_header(uint8_t *header, unsigned int frequency, uint32_t data_length)
+{
+    // wav header
+    WRITE_LE_UINT32(header, 0x46464952);            // "RIFF" tag
+    WRITE_LE_UINT32(header + 4, 36 + data_length);  // RIFF length
+    WRITE_LE_UINT32(header + 8, 0x45564157);        // "WAVE" tag
+    header += 12;
+
+    // fmt chunk
+    WRITE_LE_UINT32(header, 0x20746D66);    // "fmt " tag
+    WRITE_LE_UINT32(header + 4, 16);        // chunk length
+    header += 8;
+
+    // PCMWAVEFORMAT structure
+    WRITE_LE_UINT16(header, 1);                 // wFormatTag - 1 = PCM
+    WRITE_LE_UINT16(header + 2, 2);             // nChannels - 2 = stereo
+    WRITE_LE_UINT32(header + 4, frequency);     // nSamplesPerSec
+    WRITE_LE_UINT32(header + 8, 4 * frequency); // nAvgBytesPerSec
+    WRITE_LE_UINT16(header + 12, 4);            // nBlockAlign
+    WRITE_LE_UINT16(header + 14, 16);           // wBitsPerSample
+    header += 16;
+
+    // data chunk
+    WRITE_LE_UINT32(header, 0x61746164);        // "data" tag
+    WRITE_LE_UINT32(header + 4, data_length);   // chunk length
+}
+
+int d77r_load(const d77r_settings *settings, d77r_renderer **rendererptr)
+{
+    d77r_renderer *renderer;
+    int retval;
+
+    if ((settings == NULL) || (rendererptr == NULL)) return D77R_ERROR_INIT_SYNTH;
+    if (renderer_open) return D77R_ERROR_BUSY;
+
+    renderer = (d77r_renderer *)calloc(1, sizeof(d77r_renderer));
+    if (renderer == NULL) return D77R_ERROR_MEMORY;
+
+    renderer->settings = settings->synth;
+
+#ifdef INDIRECT_64BIT
+    // load library
+    if (!D77_LoadLibrary(settings->library))
+    {
+        free(renderer);
+        return D77R_ERROR_LIBRARY;
+    }
+#endif
+
+#ifdef PTROFS_64BIT
+    if (!D77_InitializePointerOffset())
+    {
+        free(renderer);
+        return D77R_ERROR_LIBRARY;
+    }
+#endif
+
+    // messages and settings are passed to the synth in its memory
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    renderer->input_buffer = (uint8_t *)D77_AllocateMemory(65536);
+    if (renderer->input_buffer == NULL)
+    {
+        retval = D77R_ERROR_BUFFER;
+        goto load_error;
+    }
+#endif
+
+    // load DATA file
+    renderer->datafile = d77r_load_datafile(settings->datafile, &(renderer->datafile_len));
+    if (renderer->datafile == NULL)
+    {
+        retval = D77R_ERROR_DATAFILE;
+        goto load_error;
+    }
+
+    renderer_open = 1;
+    *rendererptr = renderer;
+    return 0;
+
+load_error:
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    if (renderer->input_buffer != NULL) D77_FreeMemory(renderer->input_buffer, 65536);
+#endif
+#ifdef INDIRECT_64BIT
+    D77_FreeLibrary();
+#endif
+    free(renderer);
+    return retval;
+}
+
+int d77r_initialize(d77r_renderer *renderer, const D77_SETINGS *synth)
+{
+    if ((renderer == NULL) || (synth == NULL)) return D77R_ERROR_INIT_SYNTH;
+
+    renderer->settings = *synth;
+
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    memcpy(renderer->input_buffer, &(renderer->settings), sizeof(D77_SETINGS));
+    D77_ValidateSettings((D77_SETINGS *)renderer->input_buffer);
+    memcpy(&(renderer->settings), renderer->input_buffer, sizeof(D77_SETINGS));
+#else
+    D77_ValidateSettings(&(renderer->settings));
+#endif
+
+    if (!D77_InitializeDataFile(renderer->datafile, renderer->datafile_len - 4))
+    {
+        return D77R_ERROR_INIT_DATAFILE;
+    }
+
+    if (!D77_InitializeSynth(renderer->settings.dwSamplingFreq, renderer->settings.dwPolyphony, renderer->settings.dwTimeReso))
+    {
+        return D77R_ERROR_INIT_SYNTH;
+    }
+
+    D77_InitializeUnknown(0);
+    D77_InitializeEffect(D77_EFFECT_Reverb, renderer->settings.dwRevSw ? 1 : 0);
+    D77_InitializeEffect(D77_EFFECT_Chorus, renderer->settings.dwChoSw ? 1 : 0);
+    D77_InitializeCpuLoad(renderer->settings.dwCpuLoadL, renderer->settings.dwCpuLoadH);
+
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    renderer->parameters = (D77_PARAMETERS *)renderer->input_buffer;
+#else
+    renderer->parameters = &(renderer->param_buffer);
+#endif
+    renderer->parameters->wChoAdj = renderer->settings.dwChoAdj;
+    renderer->parameters->wRevAdj = renderer->settings.dwRevAdj;
+    renderer->parameters->wRevDrm = renderer->settings.dwRevDrm;
+    renderer->parameters->wRevFb = renderer->settings.dwRevFb;
+    renderer->parameters->wOutLev = renderer->settings.dwOutLev;
+    renderer->parameters->wResoUpAdj = renderer->settings.dwResoUpAdj;
+
+    D77_InitializeParameters(renderer->parameters);
+
+    D77_InitializeMasterVolume(renderer->settings.dwMVol);
+
+    // the samples are rendered to this buffer and passed to the sink from it
+    if (renderer->output_buffer != NULL)
+    {
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+        D77_FreeMemory(renderer->output_buffer, renderer->bytes_per_call);
+#else
+        free(renderer->output_buffer);
+#endif
+    }
+
+    renderer->frequency = renderer->settings.dwSamplingFreq;
+    renderer->samples_per_call = D77_GetRenderedSamplesPerCall();
+    renderer->bytes_per_call = renderer->samples_per_call * 2 * sizeof(int16_t);
+
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    renderer->output_buffer = (int16_t *)D77_AllocateMemory(renderer->bytes_per_call);
+#else
+    renderer->output_buffer = (int16_t *)malloc(renderer->bytes_per_call);
+#endif
+    if (renderer->output_buffer == NULL)
+    {
+        return D77R_ERROR_MEMORY;
+    }
+
+    return 0;
+}
+
+int d77r_open(const d77r_settings *settings, d77r_renderer **rendererptr)
+{
+    int retval;
+
+    retval = d77r_load(settings, rendererptr);
+    if (retval) return retval;
+
+    retval = d77r_initialize(*rendererptr, &(settings->synth));
+    if (retval)
+    {
+        d77r_close(*rendererptr);
+        *rendererptr = NULL;
+    }
+
+    return retval;
+}
+
+void d77r_close(d77r_renderer *renderer)
+{
+    if (renderer == NULL) return;
+
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    if (renderer->output_buffer != NULL) D77_FreeMemory(renderer->output_buffer, renderer->bytes_per_call);
+    d77r_free_datafile(renderer->datafile, renderer->datafile_len);
+    D77_FreeMemory(renderer->input_buffer, 65536);
+#ifdef INDIRECT_64BIT
+    D77_FreeLibrary();
+#endif
+#else
+    free(renderer->output_buffer);
+    d77r_free_datafile(renderer->datafile, renderer->datafile_len);
+#endif
+
+    free(renderer);
+    renderer_open = 0;
+}
+
+const D77_SETINGS *d77r_get_settings(const d77r_renderer *renderer)
+{
+    return &(renderer->settings);
+}
+
+unsigned int d77r_get_frequency(const d77r_renderer *renderer)
+{
+    return renderer->frequency;
+}
+
+unsigned int d77r_get_samples_per_call(const d77r_renderer *renderer)
+{
+    return renderer->samples_per_call;
+}
+
+int16_t *d77r_get_output_buffer(const d77r_renderer *renderer)
+{
+    return renderer->output_buffer;
+}
+
+const uint8_t *d77r_get_datafile(const d77r_renderer *renderer, unsigned int *length)
+{
+    if (length != NULL) *length = renderer->datafile_len;
+    return renderer->datafile;
+}
+
+uint64_t d77r_get_call_time(const d77r_renderer *renderer, unsigned int num_calls)
+{
+    // events are sent when their (exact) sample frame is not after the middle frame of the preceding call
+    return (((uint64_t)num_calls * renderer->samples_per_call + (renderer->samples_per_call >> 1)) * 1000000) / renderer->frequency;
+}
+
+unsigned int d77r_get_total_calls(const d77r_renderer *renderer, uint64_t end_time)
+{
+    unsigned int num_calls;
+
+    num_calls = (unsigned int)((end_time * renderer->frequency) / (1000000 * (uint64_t)renderer->samples_per_call));
+    while ((num_calls > 0) && (d77r_get_call_time(renderer, num_calls) >= end_time)) num_calls--;
+    while (d77r_get_call_time(renderer, num_calls) < end_time) num_calls++;
+
+    return num_calls;
+}
+
+void d77r_send_event(d77r_renderer *renderer, const midi_event_info *event)
+{
+    const uint8_t *data;
+
+    if (event->len <= 3)
+    {
+        // channel messages (and short sysex)
+        data = event->msg.data;
+        if ((data[0] & 0xf0) != 0xf0)
+        {
+            D77_MidiMessageShort(data[0] | (data[1] << 8) | (data[2] << 16));
+            return;
+        }
+    }
+    else
+    {
+        data = MIDI_EVENT_DATA(event);
+    }
+
+    if (data[0] == 0xff) return; // skip meta events
+
+    if ((data[0] == 0xf0) || (event->len > 8))
+    {
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+        if (event->len <= 65536)
+        {
+            memcpy(renderer->input_buffer, data, event->len);
+            D77_MidiMessageLong(renderer->input_buffer, event->len);
+        }
+#else
+        D77_MidiMessageLong(data, event->len);
+#endif
+    }
+    else
+    {
+        D77_MidiMessageShort(data[0] | (data[1] << 8) | (data[2] << 16));
+    }
+}
+
+unsigned int d77r_send_events(d77r_renderer *renderer, unsigned int num_calls, const midi_event_info **cur_event, unsigned int *remaining_events)
+{
+    uint64_t next_time;
+    unsigned int num_sent;
+
+    next_time = d77r_get_call_time(renderer, num_calls);
+    num_sent = 0;
+    while ((*remaining_events > 0) && ((*cur_event)->time <= next_time))
+    {
+        d77r_send_event(renderer, *cur_event);
+        num_sent++;
+
+        (*cur_event)++;
+        (*remaining_events)--;
+    }
+
+    return num_sent;
+}
+
+void d77r_reset(d77r_renderer *renderer)
+{
+    static const uint8_t gm_reset[6] = { 0xf0, 0x7e, 0x7f, 0x09, 0x01, 0xf7 };
+    unsigned int channel, num_calls, max_calls, index;
+
+    // all sounds off, reset all controllers
+    for (channel = 0; channel < 16; channel++)
+    {
+        D77_MidiMessageShort((0xb0 | channel) | (120 << 8));
+        D77_MidiMessageShort((0xb0 | channel) | (121 << 8));
+    }
+
+    // GM reset resets programs, controllers and effects to the power-up state
+#if defined(INDIRECT_64BIT) || defined(PTROFS_64BIT)
+    memcpy(renderer->input_buffer, gm_reset, sizeof(gm_reset));
+    D77_MidiMessageLong(renderer->input_buffer, sizeof(gm_reset));
+#else
+    D77_MidiMessageLong(gm_reset, sizeof(gm_reset));
+#endif
+
+    // restore the settings, which could be changed by the file
+    D77_InitializeEffect(D77_EFFECT_Reverb, renderer->settings.dwRevSw ? 1 : 0);
+    D77_InitializeEffect(D77_EFFECT_Chorus, renderer->settings.dwChoSw ? 1 : 0);
+    D77_InitializeMasterVolume(renderer->settings.dwMVol);
+
+    // render silence until the effects decay, so that the next file starts from silence
+    max_calls = d77r_get_total_calls(renderer, (uint64_t)RESET_DECAY_TIME * 1000);
+    for (num_calls = 0; num_calls < max_calls; num_calls++)
+    {
+        if (!D77_RenderSamples(renderer->output_buffer)) break;
+
+        for (index = 0; index < renderer->samples_per_call * 2; index++)
+        {
+            if (renderer->output_buffer[index] != 0) break;
+        }
+        if (index >= renderer->samples_per_call * 2) break;
+    }
+}
+
+int d77r_render_events(d77r_renderer *renderer, const midi_event_info *events, d77r_sink sink, void *user)
+{
+    const midi_event_info *cur_event;
+    unsigned int num_calls, end_call, remaining_events;
+
+    if ((renderer == NULL) || (events == NULL) || (sink == NULL)) return D77R_ERROR_RENDER;
+
+    // events are rendered up to 112 ms after the end of file
+    end_call = d77r_get_total_calls(renderer, events[0].time + 112000);
+
+    remaining_events = events[0].len;
+    cur_event = events + 1;
+    for (num_calls = 1; num_calls <= end_call; num_calls++)
+    {
+        d77r_send_events(renderer, num_calls, &cur_event, &remaining_events);
+
+        if (!D77_RenderSamples(renderer->output_buffer)) return D77R_ERROR_RENDER;
+
+        // the block is passed without copying
+        if (!sink(user, renderer->output_buffer, renderer->samples_per_call)) return D77R_ERROR_SINK;
+    }
+
+    return 0;
+}
+
+int d77r_render(d77r_renderer *renderer, const uint8_t *midi, unsigned int midilen, d77r_sink sink, void *user)
+{
+    midi_event_info *events;
+    unsigned int timediv;
+    int retval;
+
+    if ((renderer == NULL) || (sink == NULL)) return D77R_ERROR_RENDER;
+
+    if (load_midi_data(midi, midilen, &timediv, &events)) return D77R_ERROR_MIDI;
+
+    retval = d77r_render_events(renderer, events, sink, user);
+
+    free_midi_data(events);
+
+    d77r_reset(renderer);
+
+    return retval;
+}
@@ -0,0 +1,113 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#if !defined(_D77_RENDER_H_INCLUDED_)
+#define _D77_RENDER_H_INCLUDED_
+
+#include <stdint.h>
+#include "websynth.h"
+#include "midi_loader.h"
+
+// error codes (same as the exit codes of d77_pcmconvert)
+#define D77R_ERROR_LIBRARY 1
+#define D77R_ERROR_BUFFER 2
+#define D77R_ERROR_DATAFILE 3
+#define D77R_ERROR_MIDI 4
+#define D77R_ERROR_INIT_DATAFILE 5
+#define D77R_ERROR_INIT_SYNTH 6
+#define D77R_ERROR_MEMORY 7
+#define D77R_ERROR_SINK 9
+#define D77R_ERROR_RENDER 10
+// the synth has global state, only one renderer can be open at a time
+#define D77R_ERROR_BUSY 14
+
+typedef struct
+{
+    const char *datafile; // path to dsweb*.dat
+    const char *library; // path to d77_lib.so (NULL = embedded library), ignored when the synth is linked statically
+    D77_SETINGS synth;
+} d77r_settings;
+
+typedef struct d77r_renderer_ d77r_renderer;
+
+// called with each block of rendered samples (stereo, interleaved, native byte order),
+// the samples are in the synth's buffer (valid until the sink returns), the rendering stops when the sink returns 0
+typedef int (*d77r_sink)(void *user, const int16_t *samples, unsigned int num_frames);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// default settings (same as d77_pcmconvert)
+extern void d77r_default_settings(d77r_settings *settings);
+
+// loads the datafile and initializes the synth, returns 0 or error code
+extern int d77r_open(const d77r_settings *settings, d77r_renderer **rendererptr);
+extern void d77r_close(d77r_renderer *renderer);
+
+// d77r_open in two steps: loads the library and the datafile, initializes the synth
+// (e.g. in forked processes, each with different synth settings)
+extern int d77r_load(const d77r_settings *settings, d77r_renderer **rendererptr);
+extern int d77r_initialize(d77r_renderer *renderer, const D77_SETINGS *synth);
+
+// validated settings of the synth
+extern const D77_SETINGS *d77r_get_settings(const d77r_renderer *renderer);
+extern unsigned int d77r_get_frequency(const d77r_renderer *renderer);
+extern unsigned int d77r_get_samples_per_call(const d77r_renderer *renderer);
+
+// buffer in the synth's memory, the samples are rendered to it
+extern int16_t *d77r_get_output_buffer(const d77r_renderer *renderer);
+extern const uint8_t *d77r_get_datafile(const d77r_renderer *renderer, unsigned int *length);
+
+// time (in us) up to which the events are sent before rendering samples in the given call (numbered from 1)
+extern uint64_t d77r_get_call_time(const d77r_renderer *renderer, unsigned int num_calls);
+// number of calls needed to render up to the time (in us)
+extern unsigned int d77r_get_total_calls(const d77r_renderer *renderer, uint64_t end_time);
+
+// sends the event to the synth (meta events are skipped)
+extern void d77r_send_event(d77r_renderer *renderer, const midi_event_info *event);
+// sends the events which precede the given call, returns number of sent events
+extern unsigned int d77r_send_events(d77r_renderer *renderer, unsigned int num_calls, const midi_event_info **cur_event, unsigned int *remaining_events);
+
+// renders the loaded events up to 112 ms after the end of file, returns 0 or error code
+extern int d77r_render_events(d77r_renderer *renderer, const midi_event_info *events, d77r_sink sink, void *user);
+// renders the standard MIDI file up to 112 ms after the end of file, returns 0 or error code
+// the synth is reset afterwards (GM reset, effects decay), so that the next file starts from the power-up state
+extern int d77r_render(d77r_renderer *renderer, const uint8_t *midi, unsigned int midilen, d77r_sink sink, void *user);
+
+// all sounds off, GM reset, settings restored, effects decay (up to 3 s of silence is rendered, not passed to the sink)
+extern void d77r_reset(d77r_renderer *renderer);
+
+// WAV header (44 bytes) of 16-bit stereo samples
+extern void d77r_write_wav_header(uint8_t *header, unsigned int frequency, uint32_t data_length);
+
+// datafile in memory usable by the synth (also used by d77_pcmconvert)
+extern uint8_t *d77r_load_datafile(const char *datapath, int *length);
+extern void d77r_free_datafile(uint8_t *data, int length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
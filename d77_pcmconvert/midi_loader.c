@@ -26,9 +26,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 #include "midi_loader.h"
 
+#if defined(__GNUC__)
+#define INLINE __inline__
+#elif defined(_MSC_VER)
+#define INLINE __inline
+#else
+#define INLINE inline
+#endif
 
 #define GETU32FBE(buf) (                    \
             (uint32_t) ( (buf)[0] ) << 24 | \
@@ -53,29 +70,49 @@
 
 typedef struct {
     const uint8_t *ptr;
-    unsigned int len, delta;
+    unsigned int len, tick;
     uint8_t prev_event, pad[3];
     int eot;
 } midi_track_info;
 
 
+// seek points in compiled MIDI files
+#define MIDI_SEEK_INTERVAL 10000000
+
+typedef struct {
+    uint32_t controller[128]; // index of the last event (0 = none)
+    uint32_t program, program_bank[2], pitch_wheel, pressure;
+    uint32_t reset, system_reset; // index of the last reset of the controllers / of the last GM or GS reset
+} seek_channel_state;
+
+typedef struct {
+    uint32_t key; // channel, RPN / NRPN, parameter number, data entry MSB / LSB
+    uint32_t index;
+} seek_param_slot;
+
+typedef struct {
+    uint32_t index, order, message;
+} seek_message_entry;
+
+
+static void free_file(uint8_t *data, size_t size);
+
 void free_midi_data(midi_event_info *data)
 {
-    unsigned int index;
+    const midi_compiled_header *header;
 
-    if (data != NULL)
-    {
-        for (index = data[0].len; index != 0; index--)
-        {
-            if (data[index].sysex != NULL)
-            {
-                free(data[index].sysex);
-                data[index].sysex = NULL;
-            }
-        }
+    if (data == NULL) return;
 
-        free(data);
+    if (data[0].msg.offset != 0)
+    {
+        // compiled MIDI file - events are in the file data after the header
+        header = (const midi_compiled_header *)((uint8_t *)data - data[0].msg.offset);
+        free_file((uint8_t *)header, header->seek_offset + header->seek_size);
+        return;
     }
+
+    // events and the data arena are in one block
+    free(data);
 }
 
 static int readmidi(const uint8_t *midi, unsigned int midilen, unsigned int *number_of_tracks_ptr, unsigned int *time_division_ptr, midi_track_info **tracks_ptr)
@@ -199,95 +236,437 @@ static unsigned int read_varlen(midi_track_info *track)
     return (track->eot)?0:varlen;
 }
 
-static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned int *timediv, midi_event_info **dataptr)
+static int track_precedes(const midi_track_info *tracks, unsigned int track1, unsigned int track2)
+{
+    // order of tracks with events at the same tick is given by the track number
+    return (tracks[track1].tick < tracks[track2].tick) || ((tracks[track1].tick == tracks[track2].tick) && (track1 < track2));
+}
+
+static void push_track(unsigned int *heap, unsigned int *heap_len, const midi_track_info *tracks, unsigned int tracknum)
+{
+    unsigned int pos, parent;
+
+    pos = *heap_len;
+    (*heap_len)++;
+
+    while (pos != 0)
+    {
+        parent = (pos - 1) >> 1;
+        if (!track_precedes(tracks, tracknum, heap[parent])) break;
+
+        heap[pos] = heap[parent];
+        pos = parent;
+    }
+
+    heap[pos] = tracknum;
+}
+
+static unsigned int pop_track(unsigned int *heap, unsigned int *heap_len, const midi_track_info *tracks)
+{
+    unsigned int tracknum, last, pos, child;
+
+    tracknum = heap[0];
+    (*heap_len)--;
+    last = heap[*heap_len];
+
+    pos = 0;
+    for (;;)
+    {
+        child = 2 * pos + 1;
+        if (child >= *heap_len) break;
+        if ((child + 1 < *heap_len) && track_precedes(tracks, heap[child + 1], heap[child])) child++;
+        if (!track_precedes(tracks, heap[child], last)) break;
+
+        heap[pos] = heap[child];
+        pos = child;
+    }
+
+    heap[pos] = last;
+
+    return tracknum;
+}
+
+struct midi_stream_
 {
-    unsigned int number_of_tracks, time_division, index, lasttracknum, varlen;
+    uint8_t *file_data;
+    size_t file_size;
+    unsigned int number_of_tracks, time_division;
     midi_track_info *tracks, *curtrack;
-    unsigned int num_allocated, num_events, last_tick;
-    midi_event_info *events;
-    int retval, eventextralen;
-    midi_event_info event;
+    unsigned int *heap, heap_len;
+    unsigned int lasttracknum, last_tick;
     unsigned int tempo, tempo_tick;
-    uint32_t tempo_time;
+    uint64_t tempo_time, duration;
+    midi_event_info *event;
+    uint32_t event_data_size;
+};
 
-    retval = readmidi(midi, midilen, &number_of_tracks, &time_division, &tracks);
-    if (retval) return retval;
 
-    // prepare tracks
-    for (index = 0; index < number_of_tracks; index++)
+static int grow_buffer(uint8_t **data_ptr, size_t *capacity_ptr, size_t size, size_t new_size)
+{
+    size_t capacity;
+    uint8_t *data;
+
+    if (new_size <= *capacity_ptr) return 1;
+    if (new_size > UINT32_MAX) return 0;
+
+    capacity = (*capacity_ptr != 0) ? *capacity_ptr : 65536;
+    while (capacity < new_size) capacity *= 2;
+
+#ifdef _WIN32
+    data = (uint8_t *)realloc(*data_ptr, capacity);
+    if (data == NULL) return 0;
+#else
+    // the buffer is mapped, so it's released the same way as a mapped file
+    data = (uint8_t *)mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) return 0;
+
+    if (*data_ptr != NULL)
     {
-        curtrack = &(tracks[index]);
+        memcpy(data, *data_ptr, size);
+        munmap(*data_ptr, *capacity_ptr);
+    }
+#endif
 
-        // read delta
-        curtrack->delta = read_varlen(curtrack);
+    *data_ptr = data;
+    *capacity_ptr = capacity;
+    return 1;
+}
+
+static int read_input(int fd, uint8_t **data_ptr, size_t *size_ptr, size_t *capacity_ptr, size_t len)
+{
+    size_t total;
+
+    // returns 1 when all data was read, 0 at end of input, -1 on error
+    if (!grow_buffer(data_ptr, capacity_ptr, *size_ptr, *size_ptr + len)) return -1;
+
+    total = 0;
+    while (total < len)
+    {
+#ifdef _WIN32
+        size_t num_read;
+
+        (void) fd;
+        num_read = fread(*data_ptr + *size_ptr + total, 1, len - total, stdin);
+        if (num_read == 0) break;
+#else
+        ssize_t num_read;
+
+        num_read = read(fd, *data_ptr + *size_ptr + total, len - total);
+        if (num_read < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (num_read == 0) break;
+#endif
+        total += num_read;
     }
 
-    num_allocated = midilen / 4;
-    num_events = 1;
+    *size_ptr += total;
+    return (total == len) ? 1 : 0;
+}
 
-    events = (midi_event_info *) malloc(sizeof(midi_event_info) * num_allocated);
-    if (events == NULL)
+static int read_stream(int fd, uint8_t **data_ptr, size_t *size_ptr)
+{
+    uint8_t *data;
+    size_t size, capacity;
+    unsigned int number_of_tracks, index;
+    int result;
+
+    data = NULL;
+    size = 0;
+    capacity = 0;
+
+    // non-seekable input (pipe) is read by chunks - MIDI header and tracks (which are parsed later)
+    result = read_input(fd, &data, &size, &capacity, 14);
+    if ((result > 0) && (GETU32FBE(data) == 0x4D546864) && (GETU32FBE(data + 4) == 6))
     {
-        retval = 11;
-        goto midi_error_1;
+        number_of_tracks = GETU16FBE(data + 10);
+        for (index = 0; index < number_of_tracks; index++)
+        {
+            // incomplete tracks are reported when the data is parsed
+            result = read_input(fd, &data, &size, &capacity, 8);
+            if (result <= 0) break;
+
+            result = read_input(fd, &data, &size, &capacity, GETU32FBE(data + size - 4));
+            if (result <= 0) break;
+        }
+    }
+    else
+    {
+        // other data (compiled MIDI file) is read until the end of input
+        while (result > 0)
+        {
+            result = read_input(fd, &data, &size, &capacity, 65536);
+        }
     }
 
-    events[0].tick = 0;
-    events[0].len = 0;
-    events[0].sysex = NULL;
-    events[0].time = 0;
+    if (result < 0)
+    {
+#ifdef _WIN32
+        free(data);
+#else
+        if (data != NULL) munmap(data, capacity);
+#endif
+        return 25;
+    }
 
-    lasttracknum = 0;
-    last_tick = 0;
-    tempo = 500000; // 500000 MPQN = 120 BPM
-    tempo_tick = 0;
-    tempo_time = 0;
-    for (;;)
+#ifndef _WIN32
+    // release the unused part of the buffer
+    if (data != NULL)
+    {
+        size_t page_size, used;
+
+        page_size = sysconf(_SC_PAGESIZE);
+        used = (size + page_size - 1) & ~(page_size - 1);
+        if (used < capacity) munmap(data + used, capacity - used);
+        if (used == 0) data = NULL;
+    }
+#endif
+
+    *data_ptr = data;
+    *size_ptr = size;
+    return 0;
+}
+
+static int read_file(const char *filename, uint8_t **data_ptr, size_t *size_ptr)
+{
+#ifdef _WIN32
+    FILE *f;
+    long fsize;
+    uint8_t *data;
+    int retval;
+
+    // standard input is read by chunks
+    if ((filename[0] == '-') && (filename[1] == 0))
+    {
+        if (_setmode(_fileno(stdin), _O_BINARY) == -1) return 21;
+        return read_stream(0, data_ptr, size_ptr);
+    }
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&f, filename, "rb")) return 21;
+#else
+    f = fopen(filename, "rb");
+    if (f == NULL) return 21;
+#endif
+
+    data = NULL;
+
+    // get file size
+    retval = 22;
+    if (fseek(f, 0, SEEK_END)) goto FILE_ERROR;
+
+    fsize = ftell(f);
+    if (fsize == -1) goto FILE_ERROR;
+
+    if (fseek(f, 0, SEEK_SET)) goto FILE_ERROR;
+
+    // allocate memory for the whole file
+    retval = 24;
+    data = (uint8_t *)malloc(fsize);
+    if (data == NULL) goto FILE_ERROR;
+
+    // read the whole file
+    retval = 25;
+    if (fread(data, 1, fsize, f) != (unsigned long)fsize) goto FILE_ERROR;
+
+    fclose(f);
+
+    *data_ptr = data;
+    *size_ptr = fsize;
+    return 0;
+
+FILE_ERROR:
+    if (data != NULL) free(data);
+    fclose(f);
+    return retval;
+#else
+    int fd, retval;
+    struct stat statbuf;
+    void *data;
+
+    // standard input (can be a regular file or a pipe)
+    if ((filename[0] == '-') && (filename[1] == 0))
+    {
+        fd = dup(STDIN_FILENO);
+    }
+    else
+    {
+        fd = open(filename, O_RDONLY);
+    }
+    if (fd < 0) return 21;
+
+    // get file size
+    if (fstat(fd, &statbuf) || (statbuf.st_size > UINT32_MAX))
+    {
+        close(fd);
+        return 22;
+    }
+
+    // non-seekable input is read by chunks
+    if (!S_ISREG(statbuf.st_mode))
     {
-        curtrack = NULL;
+        retval = read_stream(fd, data_ptr, size_ptr);
+        close(fd);
+        return retval;
+    }
 
-        if ((lasttracknum < number_of_tracks) && (!tracks[lasttracknum].eot) && (tracks[lasttracknum].delta == 0))
+    // map the whole file, pages are read on demand
+    data = NULL;
+    if (statbuf.st_size != 0)
+    {
+        data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
         {
-            curtrack = &(tracks[lasttracknum]);
+            close(fd);
+            return 25;
         }
-        else
+    }
+
+    close(fd);
+
+    *data_ptr = (uint8_t *)data;
+    *size_ptr = statbuf.st_size;
+    return 0;
+#endif
+}
+
+static void free_file(uint8_t *data, size_t size)
+{
+    if (data == NULL) return;
+
+#ifdef _WIN32
+    free(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+static int open_stream(const uint8_t *midi, unsigned int midilen, unsigned int *timediv, midi_stream **streamptr)
+{
+    midi_stream *stream;
+    unsigned int index;
+    int retval;
+
+    stream = (midi_stream *) malloc(sizeof(midi_stream));
+    if (stream == NULL) return 16;
+
+    memset(stream, 0, sizeof(midi_stream));
+
+    retval = readmidi(midi, midilen, &stream->number_of_tracks, &stream->time_division, &stream->tracks);
+    if (retval)
+    {
+        free(stream);
+        return retval;
+    }
+
+    // prepare tracks
+    for (index = 0; index < stream->number_of_tracks; index++)
+    {
+        // read delta
+        stream->tracks[index].tick = read_varlen(&(stream->tracks[index]));
+    }
+
+    // tracks which haven't ended, ordered by the tick of their next event (binary heap)
+    stream->heap = (unsigned int *) malloc(sizeof(unsigned int) * stream->number_of_tracks);
+    if (stream->heap == NULL)
+    {
+        free(stream->tracks);
+        free(stream);
+        return 15;
+    }
+
+    stream->event = (midi_event_info *) malloc(sizeof(midi_event_info));
+    if (stream->event == NULL)
+    {
+        free(stream->heap);
+        free(stream->tracks);
+        free(stream);
+        return 16;
+    }
+
+    stream->heap_len = 0;
+    for (index = 0; index < stream->number_of_tracks; index++)
+    {
+        if (!stream->tracks[index].eot) push_track(stream->heap, &stream->heap_len, stream->tracks, index);
+    }
+
+    stream->tempo = 500000; // 500000 MPQN = 120 BPM
+
+    *timediv = stream->time_division;
+    *streamptr = stream;
+    return 0;
+}
+
+static uint8_t *get_event_data(midi_stream *stream, uint32_t len)
+{
+    midi_event_info *new_event;
+
+    // short message is stored in the event, longer message follows the event in the stream's buffer
+    if (len <= MIDI_EVENT_SHORT_LEN) return stream->event->msg.data;
+
+    if (len > stream->event_data_size)
+    {
+        new_event = (midi_event_info *) realloc(stream->event, sizeof(midi_event_info) + len);
+        if (new_event == NULL) return NULL;
+
+        stream->event = new_event;
+        stream->event_data_size = len;
+    }
+
+    stream->event->msg.offset = sizeof(midi_event_info);
+    return (uint8_t *)(stream->event + 1);
+}
+
+int midi_stream_next(midi_stream *stream, const midi_event_info **eventptr)
+{
+    midi_track_info *curtrack;
+    unsigned int varlen, tick;
+    uint64_t time;
+    uint8_t *data;
+
+    curtrack = stream->curtrack;
+    for (;;)
+    {
+        // continue with the last track when its next event has the same tick, otherwise take the first track from the heap
+        if (curtrack != NULL)
         {
-            unsigned int mindelta;
-            mindelta = UINT_MAX;
-            for (index = 0; index < number_of_tracks; index++)
+            if (curtrack->eot)
             {
-                if ((!tracks[index].eot) && (tracks[index].delta < mindelta))
-                {
-                    mindelta = tracks[index].delta;
-                    curtrack = &(tracks[index]);
-                    lasttracknum = index;
-                }
+                curtrack = NULL;
+            }
+            else if (curtrack->tick != stream->last_tick)
+            {
+                push_track(stream->heap, &stream->heap_len, stream->tracks, stream->lasttracknum);
+                curtrack = NULL;
             }
         }
 
-        if (curtrack == NULL) break;
-
-        // update deltas
-        if (curtrack->delta != 0)
-        for (index = 0; index < number_of_tracks; index++)
+        if (curtrack == NULL)
         {
-            if ((!tracks[index].eot) && (index != lasttracknum))
+            if (stream->heap_len == 0)
             {
-                tracks[index].delta -= curtrack->delta;
+                stream->curtrack = NULL;
+                return 0;
             }
+
+            stream->lasttracknum = pop_track(stream->heap, &stream->heap_len, stream->tracks);
+            curtrack = &(stream->tracks[stream->lasttracknum]);
         }
+        stream->curtrack = curtrack;
 
         // read and process data
-        event.tick = last_tick + curtrack->delta;
-        last_tick = event.tick;
-        event.sysex = NULL;
+        tick = curtrack->tick;
+        stream->last_tick = tick;
 
-        // calculate event time in miliseconds
-        event.time = (uint32_t)( ((event.tick - tempo_tick) * (uint64_t) tempo) / (time_division * 1000) ) + tempo_time;
+        // calculate event time in microseconds
+        // (tempo_time is kept in units of 1/time_division microseconds, so the rounding error doesn't accumulate over tempo changes)
+        time = (stream->tempo_time + (tick - stream->tempo_tick) * (uint64_t) stream->tempo) / stream->time_division;
 
-        if (event.time > events[0].time) events[0].time = event.time;
+        if (time > stream->duration) stream->duration = time;
 
-        eventextralen = -1;
+        data = NULL;
 
         if (*curtrack->ptr & 0x80)
         {
@@ -305,13 +684,14 @@ static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned in
             case MIDI_STATUS_PITCH_WHEEL:
                 if (curtrack->len >= 2)
                 {
-                    event.data[0] = curtrack->prev_event;
-                    event.data[1] = curtrack->ptr[0];
-                    event.data[2] = curtrack->ptr[1];
-                    event.len = 3;
+                    data = get_event_data(stream, 3);
+                    data[0] = curtrack->prev_event;
+                    data[1] = curtrack->ptr[0];
+                    data[2] = curtrack->ptr[1];
+                    data[3] = 0;
+                    stream->event->len = 3;
                     curtrack->ptr += 2;
                     curtrack->len -= 2;
-                    eventextralen = 0;
                 }
                 else
                 {
@@ -325,12 +705,14 @@ static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned in
             case MIDI_STATUS_PRESSURE:
                 if (curtrack->len >= 1)
                 {
-                    event.data[0] = curtrack->prev_event;
-                    event.data[1] = curtrack->ptr[0];
-                    event.len = 2;
+                    data = get_event_data(stream, 2);
+                    data[0] = curtrack->prev_event;
+                    data[1] = curtrack->ptr[0];
+                    data[2] = 0;
+                    data[3] = 0;
+                    stream->event->len = 2;
                     curtrack->ptr += 1;
                     curtrack->len -= 1;
-                    eventextralen = 0;
                 }
                 else
                 {
@@ -355,18 +737,16 @@ static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned in
                             {
                                 // time_division is assumed to be positive (ticks per beat / PPQN - Pulses (i.e. clocks) Per Quarter Note)
 
-                                event.data[0] = curtrack->prev_event;
-                                event.data[1] = curtrack->ptr[0];
-                                event.data[2] = curtrack->ptr[1];
-                                event.data[3] = curtrack->ptr[2];
-                                event.data[4] = curtrack->ptr[3];
-                                event.data[5] = curtrack->ptr[4];
-                                event.len = 6;
-                                eventextralen = 0;
-
-                                tempo = (((uint32_t)(curtrack->ptr[2])) << 16) | (((uint32_t)(curtrack->ptr[3])) << 8) | ((uint32_t)(curtrack->ptr[4]));
-                                tempo_tick = event.tick;
-                                tempo_time = event.time;
+                                data = get_event_data(stream, 6);
+                                if (data == NULL) return -1;
+
+                                data[0] = curtrack->prev_event;
+                                memcpy(data + 1, curtrack->ptr, 5);
+                                stream->event->len = 6;
+
+                                stream->tempo_time += (tick - stream->tempo_tick) * (uint64_t) stream->tempo;
+                                stream->tempo_tick = tick;
+                                stream->tempo = (((uint32_t)(curtrack->ptr[2])) << 16) | (((uint32_t)(curtrack->ptr[3])) << 8) | ((uint32_t)(curtrack->ptr[4]));
                             }
 
                             // read length and skip event
@@ -393,52 +773,30 @@ static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned in
                 }
                 else if ((curtrack->prev_event == 0xf0) || (curtrack->prev_event == 0xf7)) // sysex
                 {
-                    const uint8_t *startevent;
-
-                    startevent = curtrack->ptr;
+                    uint32_t len;
 
                     varlen = read_varlen(curtrack);
                     if (varlen <= curtrack->len)
                     {
-                        event.len = varlen + ((curtrack->prev_event == 0xf0)?1:0);
-                        if (event.len)
+                        len = varlen + ((curtrack->prev_event == 0xf0)?1:0);
+                        if (len)
                         {
-                            if (event.len <= 8)
+                            data = get_event_data(stream, len);
+                            if (data == NULL) return -1;
+
+                            if (curtrack->prev_event == 0xf0)
                             {
-                                if (curtrack->prev_event == 0xf0)
-                                {
-                                    event.data[0] = 0xf0;
-                                    memcpy(&(event.data[1]), curtrack->ptr, varlen);
-                                }
-                                else
-                                {
-                                    memcpy(&(event.data[0]), curtrack->ptr, varlen);
-                                }
+                                data[0] = 0xf0;
+                                memcpy(data + 1, curtrack->ptr, varlen);
                             }
                             else
                             {
-                                event.sysex = (uint8_t *) malloc(event.len);
-                                if (event.sysex == NULL)
-                                {
-                                    retval = 12;
-                                    goto midi_error_2;
-                                }
-
-                                if (curtrack->prev_event == 0xf0)
-                                {
-                                    event.sysex[0] = 0xf0;
-                                    memcpy(event.sysex + 1, curtrack->ptr, varlen);
-                                }
-                                else
-                                {
-                                    memcpy(event.sysex, curtrack->ptr, varlen);
-                                }
+                                memcpy(data, curtrack->ptr, varlen);
                             }
+                            stream->event->len = len;
 
                             curtrack->ptr += varlen;
                             curtrack->len -= varlen;
-
-                            eventextralen = (int)(1 + curtrack->ptr - startevent);
                         }
                     }
                     else
@@ -460,99 +818,898 @@ static int preprocessmidi(const uint8_t *midi, unsigned int midilen, unsigned in
                 break;
         }
 
-        if (eventextralen >= 0)
-        {
-            if (num_events >= num_allocated)
-            {
-                midi_event_info *new_events;
-
-                new_events = (midi_event_info *) realloc(events, sizeof(midi_event_info) * num_allocated * 2);
-                if (new_events == NULL)
-                {
-                    retval = 13;
-                    goto midi_error_2;
-                }
-
-                num_allocated = num_allocated * 2;
-                events = new_events;
-            }
+        // read delta
+        curtrack->tick += read_varlen(curtrack);
 
-            events[num_events] = event;
-            events[0].len = num_events;
-            num_events++;
+        if (data != NULL)
+        {
+            stream->event->time = time;
+            *eventptr = stream->event;
+            return 1;
         }
-
-        // read delta
-        curtrack->delta = read_varlen(curtrack);
     };
+}
 
-    if (events[0].len == 0)
+uint64_t midi_stream_get_duration(const midi_stream *stream)
+{
+    return stream->duration;
+}
+
+void midi_stream_close(midi_stream *stream)
+{
+    if (stream != NULL)
     {
-        retval = 14;
-        goto midi_error_2;
+        free_file(stream->file_data, stream->file_size);
+        free(stream->event);
+        free(stream->heap);
+        free(stream->tracks);
+        free(stream);
     }
+}
 
-    // return values
-    *timediv = time_division;
-    *dataptr = events;
-
-    free(tracks);
-    return 0;
-
-midi_error_2:
-    free_midi_data(events);
-midi_error_1:
-    free(tracks);
-    return retval;
+static int is_compiled_midi(const uint8_t *data, size_t size)
+{
+    return (size >= sizeof(midi_compiled_header)) && (memcmp(data, MIDI_COMPILED_MAGIC, 8) == 0);
 }
 
-int load_midi_file(const char *filename, unsigned int *timediv, midi_event_info **dataptr)
+int midi_stream_open(const char *filename, unsigned int *timediv, midi_stream **streamptr)
 {
-    FILE *f;
-    long fsize;
-    uint8_t *midi;
+    uint8_t *data;
+    size_t size;
     int retval;
 
-#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
-    if (fopen_s(&f, filename, "rb")) return 21;
-#else
-    f = fopen(filename, "rb");
-    if (f == NULL) return 21;
-#endif
+    retval = read_file(filename, &data, &size);
+    if (retval) return retval;
 
-    midi = NULL;
+    if (is_compiled_midi(data, size))
+    {
+        free_file(data, size);
+        return MIDI_LOADER_COMPILED;
+    }
 
-    // get file size
-    retval = 22;
-    if (fseek(f, 0, SEEK_END)) goto FILE_ERROR;
+    retval = open_stream(data, size, timediv, streamptr);
+    if (retval)
+    {
+        free_file(data, size);
+        return retval;
+    }
 
-    fsize = ftell(f);
-    if (fsize == -1) goto FILE_ERROR;
+    // the stream owns the file data
+    (*streamptr)->file_data = data;
+    (*streamptr)->file_size = size;
+    return 0;
+}
 
-    if (fseek(f, 0, SEEK_SET)) goto FILE_ERROR;
+int midi_stream_open_data(const uint8_t *midi, unsigned int midilen, unsigned int *timediv, midi_stream **streamptr)
+{
+    return open_stream(midi, midilen, timediv, streamptr);
+}
 
-    // allocate memory for the whole file
-    retval = 24;
-    midi = (uint8_t *)malloc(fsize);
-    if (midi == NULL) goto FILE_ERROR;
+static int preprocessmidi(midi_stream *stream, unsigned int midilen, midi_event_info **dataptr)
+{
+    unsigned int num_allocated, num_events, index;
+    uint32_t arena_size, arena_allocated;
+    midi_event_info *events;
+    const midi_event_info *event;
+    uint8_t *arena;
+    int retval;
 
-    // read the whole file
-    retval = 25;
-    if (fread(midi, 1, fsize, f) != (unsigned long)fsize) goto FILE_ERROR;
+    num_allocated = midilen / 4;
+    if (num_allocated == 0) num_allocated = 1;
+    num_events = 1;
 
-    fclose(f);
-    f = NULL;
+    events = (midi_event_info *) malloc(sizeof(midi_event_info) * num_allocated);
+    if (events == NULL)
+    {
+        return 11;
+    }
+
+    // long messages (sysex, meta events) are stored in the data arena
+    arena_size = 0;
+    arena_allocated = 4096;
+    arena = (uint8_t *) malloc(arena_allocated);
+    if (arena == NULL)
+    {
+        retval = 12;
+        goto midi_error_1;
+    }
+
+    events[0].len = 0;
+    events[0].time = 0;
+    events[0].msg.offset = 0;
+
+    for (;;)
+    {
+        retval = midi_stream_next(stream, &event);
+        if (retval == 0) break;
+        if (retval < 0)
+        {
+            retval = 12;
+            goto midi_error_2;
+        }
+
+        if (num_events >= num_allocated)
+        {
+            midi_event_info *new_events;
 
-    // preprocess midi
-    retval = preprocessmidi(midi, fsize, timediv, dataptr);
+            new_events = (midi_event_info *) realloc(events, sizeof(midi_event_info) * num_allocated * 2);
+            if (new_events == NULL)
+            {
+                retval = 13;
+                goto midi_error_2;
+            }
+
+            num_allocated = num_allocated * 2;
+            events = new_events;
+        }
+
+        events[num_events] = *event;
+
+        if (event->len > MIDI_EVENT_SHORT_LEN)
+        {
+            if (event->len > arena_allocated - arena_size)
+            {
+                uint8_t *new_arena;
+
+                while (event->len > arena_allocated - arena_size) arena_allocated *= 2;
+
+                new_arena = (uint8_t *) realloc(arena, arena_allocated);
+                if (new_arena == NULL)
+                {
+                    retval = 12;
+                    goto midi_error_2;
+                }
+
+                arena = new_arena;
+            }
+
+            // offset in the arena (until the arena is placed after the events)
+            memcpy(arena + arena_size, MIDI_EVENT_DATA(event), event->len);
+            events[num_events].msg.offset = arena_size;
+            arena_size += event->len;
+        }
+
+        events[0].len = num_events;
+        num_events++;
+    }
 
-    free(midi);
+    events[0].time = midi_stream_get_duration(stream);
 
+    if (events[0].len == 0)
+    {
+        retval = 14;
+        goto midi_error_2;
+    }
+
+    // place the arena after the events, the data offsets are relative to the event
+    {
+        midi_event_info *new_events;
+
+        new_events = (midi_event_info *) realloc(events, sizeof(midi_event_info) * num_events + arena_size);
+        if (new_events == NULL)
+        {
+            retval = 13;
+            goto midi_error_2;
+        }
+
+        events = new_events;
+    }
+
+    memcpy(events + num_events, arena, arena_size);
+    free(arena);
+
+    for (index = 1; index < num_events; index++)
+    {
+        if (events[index].len > MIDI_EVENT_SHORT_LEN)
+        {
+            events[index].msg.offset += (num_events - index) * sizeof(midi_event_info);
+        }
+    }
+
+    // return values
+    *dataptr = events;
+
+    return 0;
+
+midi_error_2:
+    free(arena);
+midi_error_1:
+    free(events);
     return retval;
+}
 
-FILE_ERROR:
-    if (midi != NULL) free(midi);
-    fclose(f);
+int load_midi_data(const uint8_t *midi, unsigned int midilen, unsigned int *timediv, midi_event_info **dataptr)
+{
+    midi_stream *stream;
+    int retval;
+
+    retval = open_stream(midi, midilen, timediv, &stream);
+    if (retval) return retval;
+
+    retval = preprocessmidi(stream, midilen, dataptr);
+
+    midi_stream_close(stream);
+    return retval;
+}
+
+uint64_t midi_checksum(const uint8_t *data, uint64_t size)
+{
+    uint64_t hash, word;
+
+    // FNV-1a computed over 64-bit words (the byte order is given by the header)
+    hash = UINT64_C(0xcbf29ce484222325);
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        memcpy(&word, data, 8);
+        hash = (hash ^ word) * UINT64_C(0x100000001b3);
+    }
+    for (; size != 0; size--, data++)
+    {
+        hash = (hash ^ *data) * UINT64_C(0x100000001b3);
+    }
+
+    return hash;
+}
+
+static int load_compiled_midi(uint8_t *data, size_t size, unsigned int *timediv, midi_event_info **dataptr)
+{
+    const midi_compiled_header *header;
+    const midi_seek_point *seek_points;
+    midi_event_info *events;
+    uint64_t messages_size;
+    unsigned int index;
+
+    header = (const midi_compiled_header *)data;
+
+    if ((header->version != MIDI_COMPILED_VERSION) ||
+        (header->header_size != sizeof(midi_compiled_header)) ||
+        (header->byte_order != MIDI_COMPILED_BYTE_ORDER) ||
+        (header->event_size != sizeof(midi_event_info)) ||
+        (header->time_division == 0) ||
+        (header->num_events == 0)
+       )
+    {
+        // unsupported version
+        return 31;
+    }
+
+    if ((header->events_size < (header->num_events + 1) * (uint64_t)sizeof(midi_event_info)) ||
+        (header->seek_offset < header->header_size + header->events_size) ||
+        (header->seek_offset > size) ||
+        (header->seek_offset & 7) ||
+        (header->seek_size != size - header->seek_offset) ||
+        (header->num_seek_points > header->seek_size / sizeof(midi_seek_point))
+       )
+    {
+        // wrong size
+        return 32;
+    }
+
+    if (midi_checksum(data + header->header_size, size - header->header_size) != header->checksum)
+    {
+        // wrong checksum
+        return 33;
+    }
+
+    events = (midi_event_info *)(data + header->header_size);
+    if ((events[0].len != header->num_events) || (events[0].msg.offset != header->header_size))
+    {
+        return 34;
+    }
+
+    // check that the data is inside the file
+    for (index = 1; index <= header->num_events; index++)
+    {
+        if ((events[index].len > MIDI_EVENT_SHORT_LEN) &&
+            ((uint64_t)index * sizeof(midi_event_info) + events[index].msg.offset + events[index].len > header->events_size)
+           )
+        {
+            return 34;
+        }
+    }
+
+    seek_points = (const midi_seek_point *)(data + header->seek_offset);
+    for (index = 0; index < header->num_seek_points; index++)
+    {
+        messages_size = seek_points[index].num_messages * (uint64_t)sizeof(uint32_t);
+        if ((seek_points[index].event_index == 0) ||
+            (seek_points[index].event_index > header->num_events) ||
+            (seek_points[index].messages_offset > header->seek_size) ||
+            (messages_size > header->seek_size - seek_points[index].messages_offset) ||
+            (seek_points[index].messages_offset & 3)
+           )
+        {
+            return 34;
+        }
+    }
+
+    // return values
+    *timediv = header->time_division;
+    *dataptr = events;
+
+    return 0;
+}
+
+int load_midi_file(const char *filename, unsigned int *timediv, midi_event_info **dataptr)
+{
+    midi_stream *stream;
+    uint8_t *data;
+    size_t size;
+    int retval;
+
+    retval = read_file(filename, &data, &size);
+    if (retval) return retval;
+
+    // compiled MIDI file is used directly
+    if (is_compiled_midi(data, size))
+    {
+        retval = load_compiled_midi(data, size, timediv, dataptr);
+        if (retval) free_file(data, size);
+        return retval;
+    }
+
+    retval = open_stream(data, size, timediv, &stream);
+    if (retval)
+    {
+        free_file(data, size);
+        return retval;
+    }
+
+    // the stream owns the file data
+    stream->file_data = data;
+    stream->file_size = size;
+
+    retval = preprocessmidi(stream, size, dataptr);
+
+    midi_stream_close(stream);
+    return retval;
+}
+
+unsigned int get_midi_seek_points(const midi_event_info *data, const midi_seek_point **seekptr)
+{
+    const midi_compiled_header *header;
+
+    if (data[0].msg.offset == 0) return 0;
+
+    header = (const midi_compiled_header *)((const uint8_t *)data - data[0].msg.offset);
+    *seekptr = (const midi_seek_point *)((const uint8_t *)header + header->seek_offset);
+    return header->num_seek_points;
+}
+
+static int compare_seek_messages(const void *entry1, const void *entry2)
+{
+    const seek_message_entry *e1 = (const seek_message_entry *)entry1, *e2 = (const seek_message_entry *)entry2;
+
+    if (e1->index != e2->index) return (e1->index < e2->index) ? -1 : 1;
+    if (e1->order != e2->order) return (e1->order < e2->order) ? -1 : 1;
+    return 0;
+}
+
+static INLINE uint32_t get_short_message(const midi_event_info *event)
+{
+    return event->msg.data[0] | (event->msg.data[1] << 8) | (event->msg.data[2] << 16);
+}
+
+static INLINE uint32_t get_valid_index(uint32_t index, uint32_t reset)
+{
+    return (index > reset) ? index : 0;
+}
+
+static unsigned int create_seek_messages(const midi_event_info *events, const seek_channel_state *channels, const seek_param_slot *slots, unsigned int num_slots, const uint32_t *sysex, unsigned int num_sysex, seek_message_entry *entries, uint32_t *messages)
+{
+    static const uint8_t param_controllers[4] = { 99, 98, 101, 100 };
+    unsigned int num_entries, num_messages, channel, controller, index, index2;
+    const seek_channel_state *state;
+    uint32_t used_params, param, order[4];
+
+    // state is restored by sending the last message of each kind in the original order
+    num_entries = 0;
+    used_params = 0;
+
+    for (channel = 0; channel < 16; channel++)
+    {
+        state = &(channels[channel]);
+
+        for (controller = 0; controller < 128; controller++)
+        {
+            // data entry is sent with the parameter number (below)
+            if ((controller == 6) || (controller == 38)) continue;
+
+            if (state->controller[controller])
+            {
+                entries[num_entries].index = state->controller[controller];
+                entries[num_entries].order = 2;
+                entries[num_entries].message = get_short_message(events + state->controller[controller]);
+                num_entries++;
+            }
+        }
+
+        if (state->program)
+        {
+            // program change is preceded by the bank select which was valid at the time
+            for (index = 0; index < 2; index++)
+            {
+                if (state->program_bank[index])
+                {
+                    entries[num_entries].index = state->program;
+                    entries[num_entries].order = index;
+                    entries[num_entries].message = get_short_message(events + state->program_bank[index]);
+                    num_entries++;
+                }
+            }
+
+            entries[num_entries].index = state->program;
+            entries[num_entries].order = 2;
+            entries[num_entries].message = get_short_message(events + state->program);
+            num_entries++;
+        }
+
+        if (state->pitch_wheel)
+        {
+            entries[num_entries].index = state->pitch_wheel;
+            entries[num_entries].order = 2;
+            entries[num_entries].message = get_short_message(events + state->pitch_wheel);
+            num_entries++;
+        }
+
+        if (state->pressure)
+        {
+            entries[num_entries].index = state->pressure;
+            entries[num_entries].order = 2;
+            entries[num_entries].message = get_short_message(events + state->pressure);
+            num_entries++;
+        }
+    }
+
+    for (index = 0; index < num_slots; index++)
+    {
+        // data entry is preceded by the parameter number which was valid at the time
+        channel = slots[index].key >> 16;
+        param = slots[index].key & 0x3fff;
+        controller = (slots[index].key & 0x4000) ? 99 : 101;
+        used_params |= 1 << channel;
+
+        entries[num_entries].index = slots[index].index;
+        entries[num_entries].order = 0;
+        entries[num_entries].message = (0xb0 | channel) | (controller << 8) | ((param >> 7) << 16);
+        num_entries++;
+
+        entries[num_entries].index = slots[index].index;
+        entries[num_entries].order = 1;
+        entries[num_entries].message = (0xb0 | channel) | ((controller - 1) << 8) | ((param & 0x7f) << 16);
+        num_entries++;
+
+        entries[num_entries].index = slots[index].index;
+        entries[num_entries].order = 2;
+        entries[num_entries].message = get_short_message(events + slots[index].index);
+        num_entries++;
+    }
+
+    for (index = 0; index < num_sysex; index++)
+    {
+        entries[num_entries].index = sysex[index];
+        entries[num_entries].order = 2;
+        entries[num_entries].message = MIDI_SEEK_EVENT | sysex[index];
+        num_entries++;
+    }
+
+    qsort(entries, num_entries, sizeof(seek_message_entry), compare_seek_messages);
+
+    for (index = 0; index < num_entries; index++)
+    {
+        messages[index] = entries[index].message;
+    }
+    num_messages = num_entries;
+
+    // restore the parameter numbers (unset numbers first, then the set numbers in the original order)
+    for (channel = 0; channel < 16; channel++)
+    {
+        if (!(used_params & (1 << channel))) continue;
+
+        state = &(channels[channel]);
+        for (index = 0; index < 4; index++)
+        {
+            order[index] = get_valid_index(state->controller[param_controllers[index]], state->reset);
+            if (order[index] == 0)
+            {
+                messages[num_messages++] = (0xb0 | channel) | (param_controllers[index] << 8) | (0x7f << 16);
+            }
+        }
+
+        for (;;)
+        {
+            index2 = 4;
+            for (index = 0; index < 4; index++)
+            {
+                if (order[index] && ((index2 == 4) || (order[index] < order[index2]))) index2 = index;
+            }
+            if (index2 == 4) break;
+
+            messages[num_messages++] = get_short_message(events + order[index2]);
+            order[index2] = 0;
+        }
+    }
+
+    return num_messages;
+}
+
+int is_midi_reset(const midi_event_info *event)
+{
+    const uint8_t *data;
+
+    data = MIDI_EVENT_DATA(event);
+
+    // GM system on
+    if ((event->len >= 5) && (data[0] == 0xf0) && (data[1] == 0x7e) && (data[3] == 0x09) && (data[4] == 0x01)) return 1;
+
+    // GS reset
+    if ((event->len >= 8) && (data[0] == 0xf0) && (data[1] == 0x41) && (data[3] == 0x42) && (data[4] == 0x12) && (data[5] == 0x40) && (data[6] == 0x00) && (data[7] == 0x7f)) return 1;
+
+    return 0;
+}
+
+static int same_sysex_address(const midi_event_info *event1, const midi_event_info *event2)
+{
+    const uint8_t *data1, *data2;
+
+    // Roland data set to the same address with the same size (GS reset isn't replaced, it affects the whole state)
+    if ((event1->len != event2->len) || (event1->len < 10) || is_midi_reset(event2)) return 0;
+
+    data1 = MIDI_EVENT_DATA(event1);
+    data2 = MIDI_EVENT_DATA(event2);
+
+    return (data1[0] == 0xf0) && (data1[1] == 0x41) && (data1[4] == 0x12) && (memcmp(data1, data2, 8) == 0);
+}
+
+static int create_seek_points(const midi_event_info *events, uint8_t **seekptr, uint64_t *seeksize, unsigned int *numseekptr)
+{
+    seek_channel_state *channels, *state;
+    seek_param_slot *slots;
+    seek_message_entry *entries;
+    midi_seek_point *seek_points;
+    uint32_t *sysex, *messages;
+    unsigned int num_events, num_slots, num_sysex, num_seek_points, num_messages, allocated_entries, index, index2, channel, controller, nrpn;
+    uint64_t next_time;
+    uint32_t key, param_msb, param_lsb, rpn_index, nrpn_index;
+    const uint8_t *data;
+    uint8_t *seek_data;
+    int retval;
+
+    num_events = events[0].len;
+
+    channels = (seek_channel_state *) calloc(16, sizeof(seek_channel_state));
+    slots = (seek_param_slot *) malloc(sizeof(seek_param_slot) * num_events);
+    sysex = (uint32_t *) malloc(sizeof(uint32_t) * num_events);
+    seek_points = (midi_seek_point *) malloc(sizeof(midi_seek_point) * (events[0].time / MIDI_SEEK_INTERVAL + 1));
+    entries = NULL;
+    messages = NULL;
+
+    retval = 41;
+    if ((channels == NULL) || (slots == NULL) || (sysex == NULL) || (seek_points == NULL)) goto seek_error;
+
+    num_slots = 0;
+    num_sysex = 0;
+    num_seek_points = 0;
+    num_messages = 0;
+    allocated_entries = 0;
+    next_time = MIDI_SEEK_INTERVAL;
+
+    for (index = 1; index <= num_events; index++)
+    {
+        if ((events[index].time >= next_time) && (index > 1))
+        {
+            // seek point before the event
+            unsigned int max_entries, new_messages;
+
+            max_entries = 16 * (128 + 3 + 4) + 3 * num_slots + num_sysex;
+            if (max_entries > allocated_entries)
+            {
+                seek_message_entry *new_entries;
+
+                new_entries = (seek_message_entry *) realloc(entries, sizeof(seek_message_entry) * max_entries);
+                if (new_entries == NULL) goto seek_error;
+
+                entries = new_entries;
+                allocated_entries = max_entries;
+            }
+
+            {
+                uint32_t *new_messages_ptr;
+
+                new_messages_ptr = (uint32_t *) realloc(messages, sizeof(uint32_t) * (num_messages + max_entries));
+                if (new_messages_ptr == NULL) goto seek_error;
+
+                messages = new_messages_ptr;
+            }
+
+            new_messages = create_seek_messages(events, channels, slots, num_slots, sysex, num_sysex, entries, messages + num_messages);
+
+            seek_points[num_seek_points].time = events[index - 1].time;
+            seek_points[num_seek_points].event_index = index;
+            seek_points[num_seek_points].num_messages = new_messages;
+            seek_points[num_seek_points].messages_offset = num_messages; // converted to offset later
+            num_seek_points++;
+            num_messages += new_messages;
+
+            next_time = (events[index].time / MIDI_SEEK_INTERVAL + 1) * MIDI_SEEK_INTERVAL;
+        }
+
+        data = MIDI_EVENT_DATA(events + index);
+
+        if ((events[index].len > 3) || ((data[0] & 0xf0) == 0xf0))
+        {
+            if (data[0] == 0xff) continue;
+
+            if (is_midi_reset(events + index))
+            {
+                for (channel = 0; channel < 16; channel++)
+                {
+                    channels[channel].reset = index;
+                    channels[channel].system_reset = index;
+                }
+            }
+
+            // sysex - only the last data set to the same address is kept
+            for (index2 = 0; index2 < num_sysex; index2++)
+            {
+                if (same_sysex_address(events + sysex[index2], events + index))
+                {
+                    memmove(sysex + index2, sysex + index2 + 1, sizeof(uint32_t) * (num_sysex - index2 - 1));
+                    num_sysex--;
+                    break;
+                }
+            }
+            sysex[num_sysex++] = index;
+            continue;
+        }
+
+        channel = data[0] & 0x0f;
+        state = &(channels[channel]);
+
+        switch (data[0] >> 4)
+        {
+            case MIDI_STATUS_CONTROLLER:
+                controller = data[1];
+                if ((controller == 96) || (controller == 97))
+                {
+                    // data increment / decrement - the state can't be stored, no more seek points
+                    next_time = UINT64_MAX;
+                }
+                else if ((controller == 6) || (controller == 38))
+                {
+                    // data entry is stored for each parameter (the last selected of RPN / NRPN)
+                    rpn_index = get_valid_index(state->controller[101], state->reset);
+                    if (get_valid_index(state->controller[100], state->reset) > rpn_index) rpn_index = state->controller[100];
+                    nrpn_index = get_valid_index(state->controller[99], state->reset);
+                    if (get_valid_index(state->controller[98], state->reset) > nrpn_index) nrpn_index = state->controller[98];
+
+                    nrpn = (nrpn_index > rpn_index) ? 1 : 0;
+                    param_msb = get_valid_index(state->controller[nrpn ? 99 : 101], state->reset);
+                    param_lsb = get_valid_index(state->controller[nrpn ? 98 : 100], state->reset);
+
+                    key = (channel << 16) | ((controller == 38) ? 0x8000 : 0) | (nrpn << 14) |
+                          ((param_msb ? events[param_msb].msg.data[2] : 0x7f) << 7) |
+                          (param_lsb ? events[param_lsb].msg.data[2] : 0x7f);
+
+                    for (index2 = 0; index2 < num_slots; index2++)
+                    {
+                        if (slots[index2].key == key) break;
+                    }
+                    if (index2 == num_slots)
+                    {
+                        slots[index2].key = key;
+                        num_slots++;
+                    }
+                    slots[index2].index = index;
+                }
+                else
+                {
+                    if (controller == 121) state->reset = index; // reset all controllers
+                    state->controller[controller] = index;
+                }
+                break;
+
+            case MIDI_STATUS_PROG_CHANGE:
+                state->program = index;
+                state->program_bank[0] = get_valid_index(state->controller[0], state->system_reset);
+                state->program_bank[1] = get_valid_index(state->controller[32], state->system_reset);
+                break;
+
+            case MIDI_STATUS_PITCH_WHEEL:
+                state->pitch_wheel = index;
+                break;
+
+            case MIDI_STATUS_PRESSURE:
+                state->pressure = index;
+                break;
+
+            default:
+                // notes aren't part of the state
+                break;
+        }
+    }
+
+    // seek points are followed by the messages
+    seek_data = (uint8_t *) malloc(sizeof(midi_seek_point) * num_seek_points + sizeof(uint32_t) * num_messages + 1);
+    if (seek_data == NULL) goto seek_error;
+
+    for (index = 0; index < num_seek_points; index++)
+    {
+        seek_points[index].messages_offset = sizeof(midi_seek_point) * num_seek_points + sizeof(uint32_t) * seek_points[index].messages_offset;
+    }
+    memcpy(seek_data, seek_points, sizeof(midi_seek_point) * num_seek_points);
+    if (num_messages) memcpy(seek_data + sizeof(midi_seek_point) * num_seek_points, messages, sizeof(uint32_t) * num_messages);
+
+    *seekptr = seek_data;
+    *seeksize = sizeof(midi_seek_point) * num_seek_points + sizeof(uint32_t) * num_messages;
+    *numseekptr = num_seek_points;
+    retval = 0;
+
+seek_error:
+    free(messages);
+    free(entries);
+    free(seek_points);
+    free(sysex);
+    free(slots);
+    free(channels);
     return retval;
 }
 
+static midi_event_info *copy_events(const midi_event_info *data, const uint8_t *keep, uint64_t *size_ptr)
+{
+    midi_event_info *events;
+    unsigned int num_events, index;
+    uint64_t arena_size, events_size, arena_offset;
+
+    // events are copied with their data to a new block (padded to 8 bytes), keep[index] selects the events
+    num_events = 0;
+    arena_size = 0;
+    for (index = 1; index <= data[0].len; index++)
+    {
+        if (!keep[index]) continue;
+
+        num_events++;
+        if (data[index].len > MIDI_EVENT_SHORT_LEN) arena_size += data[index].len;
+    }
+
+    if (num_events == 0) return NULL;
+
+    events_size = sizeof(midi_event_info) * (uint64_t)(num_events + 1) + arena_size;
+    events = (midi_event_info *) calloc(1, (events_size + 7) & ~(uint64_t)7);
+    if (events == NULL) return NULL;
+
+    events[0].time = data[0].time;
+    events[0].len = num_events;
+    events[0].msg.offset = 0;
+
+    num_events = 0;
+    arena_offset = sizeof(midi_event_info) * (uint64_t)(events[0].len + 1);
+    for (index = 1; index <= data[0].len; index++)
+    {
+        if (!keep[index]) continue;
+
+        num_events++;
+        events[num_events] = data[index];
+        if (data[index].len > MIDI_EVENT_SHORT_LEN)
+        {
+            memcpy((uint8_t *)events + arena_offset, MIDI_EVENT_DATA(data + index), data[index].len);
+            events[num_events].msg.offset = arena_offset - num_events * sizeof(midi_event_info);
+            arena_offset += data[index].len;
+        }
+    }
+
+    *size_ptr = events_size;
+    return events;
+}
+
+int filter_midi_data(const midi_event_info *data, const uint8_t *keep, midi_event_info **dataptr)
+{
+    midi_event_info *events;
+    uint64_t events_size;
+
+    events = copy_events(data, keep, &events_size);
+    if (events == NULL) return 41;
+
+    *dataptr = events;
+    return 0;
+}
+
+int save_compiled_midi(const char *filename, const midi_event_info *data, unsigned int timediv, uint64_t source_size, uint64_t source_hash)
+{
+    midi_compiled_header header;
+    midi_event_info *events;
+    unsigned int num_events, index;
+    uint64_t events_size, seek_size;
+    uint8_t *block, *keep, *seek_data;
+    unsigned int num_seek_points;
+    FILE *f;
+    int retval;
+
+    // meta events aren't needed for rendering, the tempo map is already applied to the event times
+    keep = (uint8_t *) malloc(data[0].len + 1);
+    if (keep == NULL) return 41;
+
+    num_events = 0;
+    for (index = 1; index <= data[0].len; index++)
+    {
+        keep[index] = (MIDI_EVENT_DATA(data + index)[0] != 0xff) ? 1 : 0;
+        num_events += keep[index];
+    }
+
+    events = (num_events != 0) ? copy_events(data, keep, &events_size) : NULL;
+    free(keep);
+    if (events == NULL) return (num_events != 0) ? 41 : 14;
+
+    block = (uint8_t *)events;
+    num_events = events[0].len;
+
+    retval = create_seek_points(events, &seek_data, &seek_size, &num_seek_points);
+    if (retval)
+    {
+        free(block);
+        return retval;
+    }
+
+    events[0].msg.offset = sizeof(midi_compiled_header);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MIDI_COMPILED_MAGIC, 8);
+    header.version = MIDI_COMPILED_VERSION;
+    header.header_size = sizeof(midi_compiled_header);
+    header.byte_order = MIDI_COMPILED_BYTE_ORDER;
+    header.event_size = sizeof(midi_event_info);
+    header.time_division = timediv;
+    header.num_events = num_events;
+    header.num_seek_points = num_seek_points;
+    header.events_size = events_size;
+    header.seek_offset = sizeof(midi_compiled_header) + ((events_size + 7) & ~(uint64_t)7);
+    header.seek_size = seek_size;
+    header.source_size = source_size;
+    header.source_hash = source_hash;
+
+    // checksum of the events (with padding) followed by the seek points
+    {
+        uint8_t *checksum_data;
+
+        retval = 41;
+        checksum_data = (uint8_t *) malloc(header.seek_offset - sizeof(midi_compiled_header) + seek_size + 1);
+        if (checksum_data == NULL) goto save_error_1;
+
+        memcpy(checksum_data, block, header.seek_offset - sizeof(midi_compiled_header));
+        memcpy(checksum_data + header.seek_offset - sizeof(midi_compiled_header), seek_data, seek_size);
+        header.checksum = midi_checksum(checksum_data, header.seek_offset - sizeof(midi_compiled_header) + seek_size);
+        free(checksum_data);
+    }
+
+#if (defined(_MSC_VER) && __STDC_WANT_SECURE_LIB__) || (defined(__MINGW32__) && defined(_UCRT)) || (defined(__STDC_LIB_EXT1__) && __STDC_WANT_LIB_EXT1__)
+    if (fopen_s(&f, filename, "wb")) f = NULL;
+#else
+    f = fopen(filename, "wb");
+#endif
+    retval = 42;
+    if (f == NULL) goto save_error_1;
+
+    retval = 43;
+    if ((fwrite(&header, 1, sizeof(header), f) != sizeof(header)) ||
+        (fwrite(block, 1, header.seek_offset - sizeof(midi_compiled_header), f) != header.seek_offset - sizeof(midi_compiled_header)) ||
+        (fwrite(seek_data, 1, seek_size, f) != seek_size)
+       )
+    {
+        fclose(f);
+        remove(filename);
+        goto save_error_1;
+    }
+
+    if (fclose(f))
+    {
+        remove(filename);
+        goto save_error_1;
+    }
+
+    retval = 0;
+
+save_error_1:
+    free(seek_data);
+    free(block);
+    return retval;
+}
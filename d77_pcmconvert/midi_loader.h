@@ -27,21 +27,81 @@
 
 #include <stdint.h>
 
+#define MIDI_EVENT_SHORT_LEN 4
+
 typedef struct
 {
-    uint32_t tick;
-    uint8_t data[8];
+    uint64_t time; // microseconds
     uint32_t len;
-    uint8_t *sysex;
-    uint32_t time;
+    union {
+        uint8_t data[MIDI_EVENT_SHORT_LEN]; // message (up to MIDI_EVENT_SHORT_LEN bytes)
+        uint32_t offset; // offset of longer message (sysex, meta event) from the event
+    } msg;
 } midi_event_info;
 
+// message of the event
+#define MIDI_EVENT_DATA(event) (((event)->len <= MIDI_EVENT_SHORT_LEN) ? (event)->msg.data : ((const uint8_t *)(event) + (event)->msg.offset))
+
+typedef struct midi_stream_ midi_stream;
+
+// compiled MIDI file - header, events (with the data arena) and seek points
+#define MIDI_COMPILED_MAGIC "D77MIDI"
+#define MIDI_COMPILED_VERSION 1
+#define MIDI_COMPILED_BYTE_ORDER 0x01020304
+
+typedef struct
+{
+    uint8_t magic[8];
+    uint32_t version, header_size, byte_order, event_size;
+    uint32_t time_division, num_events, num_seek_points, reserved;
+    uint64_t events_size; // events follow the header
+    uint64_t seek_offset, seek_size;
+    uint64_t source_size, source_hash;
+    uint64_t checksum; // checksum of everything after the header
+    uint64_t reserved2;
+} midi_compiled_header;
+
+typedef struct
+{
+    uint64_t time; // time of the last event before the seek point
+    uint32_t event_index; // index of the first event after the seek point
+    uint32_t num_messages;
+    uint64_t messages_offset; // offset of the messages from the first seek point
+} midi_seek_point;
+
+// seek point message is either a short message or an index of an event to send (sysex)
+#define MIDI_SEEK_EVENT 0x80000000
+
+// returned by midi_stream_open for compiled MIDI files (which must be loaded using load_midi_file)
+#define MIDI_LOADER_COMPILED 30
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// events are stored in one block with the data arena, events[0].len is the number of events, events[0].time is the duration
 extern void free_midi_data(midi_event_info *data);
+extern int load_midi_data(const uint8_t *midi, unsigned int midilen, unsigned int *timediv, midi_event_info **dataptr);
 extern int load_midi_file(const char *filename, unsigned int *timediv, midi_event_info **dataptr);
+// copy of the events selected by keep[index] (index 1 to data[0].len)
+extern int filter_midi_data(const midi_event_info *data, const uint8_t *keep, midi_event_info **dataptr);
+// GM system on or GS reset sysex
+extern int is_midi_reset(const midi_event_info *event);
+
+// compiled MIDI files are loaded by load_midi_file (the file is mapped to memory and used directly)
+// the seek points contain the messages which restore the state (programs, controllers, sysex, ...) at the seek point
+extern unsigned int get_midi_seek_points(const midi_event_info *data, const midi_seek_point **seekptr);
+extern uint64_t midi_checksum(const uint8_t *data, uint64_t size);
+extern int save_compiled_midi(const char *filename, const midi_event_info *data, unsigned int timediv, uint64_t source_size, uint64_t source_hash);
+
+// streaming interface - events are merged from the tracks on demand
+// midi_stream_next returns 1 when event was read, 0 at end of stream, -1 on error
+// (the event is valid until the next call)
+extern int midi_stream_open(const char *filename, unsigned int *timediv, midi_stream **streamptr);
+extern int midi_stream_open_data(const uint8_t *midi, unsigned int midilen, unsigned int *timediv, midi_stream **streamptr);
+extern int midi_stream_next(midi_stream *stream, const midi_event_info **eventptr);
+extern uint64_t midi_stream_get_duration(const midi_stream *stream);
+extern void midi_stream_close(midi_stream *stream);
 
 #ifdef __cplusplus
 }
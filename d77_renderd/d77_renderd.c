@@ -0,0 +1,1079 @@
+/**
+ *
+ *  Copyright (C) 2026 Roman Pauer
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy of
+ *  this software and associated documentation files (the "Software"), to deal in
+ *  the Software without restriction, including without limitation the rights to
+ *  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *  of the Software, and to permit persons to whom the Software is furnished to do
+ *  so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "websynth.h"
+#include "midi_loader.h"
+#include "d77_render.h"
+
+
+// maximum length of request header
+#define REQUEST_HEADER_SIZE 4096
+// maximum length of MIDI data sent in request
+#define REQUEST_DATA_SIZE (64 * 1024 * 1024)
+
+
+static d77r_settings render_settings;
+static int daemonize;
+static const char *socket_path = "/tmp/d77_renderd.socket";
+static unsigned int socket_mode;
+static const char *file_dirpath = NULL; // FILE requests are disabled
+static char *file_dirprefix;
+static unsigned int num_workers;
+
+static d77r_renderer *renderer;
+static unsigned int frequency, bytes_per_call;
+
+static int listen_fd = -1;
+static pid_t *worker_pids;
+static volatile sig_atomic_t terminate;
+
+static uint8_t send_buffer[65536];
+static unsigned int send_length;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+static int16_t swap_buffer[32768];
+#endif
+
+
+static void usage(const char *progname)
+{
+    static const char basename[] = "d77_renderd";
+
+    if (progname == NULL)
+    {
+        progname = basename;
+    }
+    else
+    {
+        const char *slash;
+
+        slash = strrchr(progname, '/');
+        if (slash != NULL)
+        {
+            progname = slash + 1;
+        }
+    }
+
+    printf(
+        "%s - WebSynth D-77 render server\n"
+        "Usage: %s [OPTIONS]...\n"
+        "  -w PATH  Datafile path (path to dsweb*.dat)\n"
+#ifdef INDIRECT_64BIT
+        "  -b PATH  Library path (path to d77_lib.so)\n"
+#endif
+        "  -s PATH  Socket path (default: /tmp/d77_renderd.socket)\n"
+        "  -M MODE  Socket permissions (octal, default: 600 = only the user running the server)\n"
+        "  -F PATH  Directory with files for FILE requests (default: FILE requests are disabled)\n"
+        "  -j NUM   Number of worker processes (default: number of CPUs)\n"
+        "  -f NUM   Frequency (22050/44100 Hz)\n"
+        "  -p NUM   Polyphony (8-256)\n"
+        "  -m NUM   Master volume (0-200)\n"
+        "  -r NUM   Reverb effect (0=off, 1=on)\n"
+        "  -c NUM   Chorus effect (0=off, 1=on)\n"
+        "  -l NUM   Cpu load (20-85)\n"
+        "  -d       Daemonize\n"
+        "  -h       Help\n"
+        "Advanced parameters:\n"
+        "  -aRevAdj NUM     (0-200)\n"
+        "  -aChoAdj NUM     (0-200)\n"
+        "  -aOutLev NUM     (0-200)\n"
+        "  -aRevFb NUM      (0-200)\n"
+        "  -aRevDrm NUM     (0-200)\n"
+        "  -aResoUpAdj NUM  (0-100)\n"
+        "Request (header lines terminated by an empty line):\n"
+        "  FILE path        Render SMF file (path on the server, relative to or inside the -F directory)\n"
+        "  DATA length      Render SMF data following the header\n"
+        "  FORMAT wav|raw   Output format (default: wav)\n"
+        "  VOLUME NUM       Master volume (0-200)\n"
+        "  REVERB NUM       Reverb effect (0=off, 1=on)\n"
+        "  CHORUS NUM       Chorus effect (0=off, 1=on)\n"
+        "Response:\n"
+        "  OK length        followed by output data\n"
+        "  ERROR message\n",
+        basename,
+        progname
+    );
+    exit(1);
+}
+
+static void read_arguments(int argc, char *argv[]) __attribute__((noinline));
+static void read_arguments(int argc, char *argv[])
+{
+    int i, j;
+
+    // default settings from .ini file
+    d77r_default_settings(&render_settings);
+
+    daemonize = 0;
+    num_workers = 0;
+    socket_mode = 0600;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0)
+        {
+            switch (argv[i][1])
+            {
+                case 'w': // data file
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        render_settings.datafile = argv[i];
+                    }
+                    break;
+#ifdef INDIRECT_64BIT
+                case 'b': // library
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        render_settings.library = argv[i];
+                    }
+                    break;
+#endif
+                case 's': // socket
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        socket_path = argv[i];
+                    }
+                    break;
+                case 'M': // socket permissions
+                    if ((i + 1) < argc)
+                    {
+                        char *end;
+                        long mode;
+
+                        i++;
+                        mode = strtol(argv[i], &end, 8);
+                        if ((*end == 0) && (mode >= 0) && (mode <= 0777))
+                        {
+                            socket_mode = mode;
+                        }
+                    }
+                    break;
+                case 'F': // directory for FILE requests
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        file_dirpath = argv[i];
+                    }
+                    break;
+                case 'j': // workers
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 1 && j <= 256)
+                        {
+                            num_workers = j;
+                        }
+                    }
+                    break;
+                case 'f': // frequency
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j == 22050 || j == 44100)
+                        {
+                            render_settings.synth.dwSamplingFreq = j;
+                        }
+                    }
+                    break;
+                case 'p': // polyphony
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0)
+                        {
+                            render_settings.synth.dwPolyphony = j;
+                        }
+                    }
+                    break;
+                case 'm': // master volume
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 200)
+                        {
+                            render_settings.synth.dwMVol = j;
+                        }
+                    }
+                    break;
+                case 'r': // reverb effect
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 1)
+                        {
+                            render_settings.synth.dwRevSw = j;
+                        }
+                    }
+                    break;
+                case 'c': // chorus effect
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 0 && j <= 1)
+                        {
+                            render_settings.synth.dwChoSw = j;
+                        }
+                    }
+                    break;
+                case 'l': // cpu load
+                    if ((i + 1) < argc)
+                    {
+                        i++;
+                        j = atoi(argv[i]);
+                        if (j >= 20 && j <= 85)
+                        {
+                            render_settings.synth.dwCpuLoadL = j;
+                        }
+                    }
+                    break;
+                case 'd': // daemonize
+                    daemonize = 1;
+                    break;
+                case 'h': // help
+                    usage(argv[0]);
+                default:
+                    break;
+            }
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == 'a')
+        {
+            if (0 == strcmp(argv[i] + 2, "RevAdj"))
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0 && j <= 200)
+                    {
+                        render_settings.synth.dwRevAdj = j;
+                    }
+                }
+            }
+            else if (0 == strcmp(argv[i] + 2, "ChoAdj"))
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0 && j <= 200)
+                    {
+                        render_settings.synth.dwChoAdj = j;
+                    }
+                }
+            }
+            else if (0 == strcmp(argv[i] + 2, "OutLev"))
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0 && j <= 200)
+                    {
+                        render_settings.synth.dwOutLev = j;
+                    }
+                }
+            }
+            else if (0 == strcmp(argv[i] + 2, "RevFb"))
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0 && j <= 200)
+                    {
+                        render_settings.synth.dwRevFb = j;
+                    }
+                }
+            }
+            else if (0 == strcmp(argv[i] + 2, "RevDrm"))
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0 && j <= 200)
+                    {
+                        render_settings.synth.dwRevDrm = j;
+                    }
+                }
+            }
+            else if (0 == strcmp(argv[i] + 2, "ResoUpAdj"))
+            {
+                if ((i + 1) < argc)
+                {
+                    i++;
+                    j = atoi(argv[i]);
+                    if (j >= 0 && j <= 100)
+                    {
+                        render_settings.synth.dwResoUpAdj = j;
+                    }
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+        }
+    }
+
+    if (num_workers == 0)
+    {
+        long num_cpus;
+
+        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_cpus >= 1 && num_cpus <= 256) ? num_cpus : 1;
+    }
+}
+
+
+static void stop_synth(void)
+{
+    d77r_close(renderer);
+    renderer = NULL;
+}
+
+static int start_synth(void) __attribute__((noinline));
+static int start_synth(void)
+{
+    switch (d77r_open(&render_settings, &renderer))
+    {
+        case 0:
+            break;
+        case D77R_ERROR_LIBRARY:
+#ifdef INDIRECT_64BIT
+            fprintf(stderr, "Error loading library: %s\n", render_settings.library);
+#else
+            fprintf(stderr, "Error initializing pointer offset\n");
+#endif
+            return -1;
+        case D77R_ERROR_DATAFILE:
+            fprintf(stderr, "Error opening DATA file: %s\n", render_settings.datafile);
+            return -2;
+        case D77R_ERROR_INIT_DATAFILE:
+            fprintf(stderr, "Error initializing DATA file\n");
+            return -4;
+        case D77R_ERROR_INIT_SYNTH:
+            fprintf(stderr, "Error initializing synth\n");
+            return -5;
+        default:
+            fprintf(stderr, "Error allocating memory buffers\n");
+            return -3;
+    }
+
+    // prepare output buffer
+    frequency = d77r_get_frequency(renderer);
+    bytes_per_call = d77r_get_samples_per_call(renderer) * 2 * sizeof(int16_t);
+
+    if (bytes_per_call > sizeof(send_buffer))
+    {
+        fprintf(stderr, "Unsupported D77 parameters: %i, %i\n", frequency, d77r_get_samples_per_call(renderer));
+        stop_synth();
+        return -6;
+    }
+
+    return 0;
+}
+
+static int open_file_directory(void)
+{
+    char *dirpath;
+    size_t length;
+
+    if (file_dirpath == NULL) return 0;
+
+    dirpath = realpath(file_dirpath, NULL);
+    if (dirpath == NULL)
+    {
+        fprintf(stderr, "Error opening directory: %s\n", file_dirpath);
+        return -1;
+    }
+
+    // requested files must be inside the directory
+    length = strlen(dirpath);
+    file_dirprefix = (char *)malloc(length + 2);
+    if (file_dirprefix == NULL)
+    {
+        free(dirpath);
+        fprintf(stderr, "Error allocating memory\n");
+        return -2;
+    }
+
+    strcpy(file_dirprefix, dirpath);
+    if ((length == 0) || (dirpath[length - 1] != '/')) strcat(file_dirprefix, "/");
+    free(dirpath);
+
+    return 0;
+}
+
+static char *get_file_path(const char *filepath)
+{
+    char *path, *resolved;
+
+    // relative paths are relative to the directory
+    if (filepath[0] == '/')
+    {
+        resolved = realpath(filepath, NULL);
+    }
+    else
+    {
+        path = (char *)malloc(strlen(file_dirprefix) + strlen(filepath) + 1);
+        if (path == NULL) return NULL;
+
+        strcpy(path, file_dirprefix);
+        strcat(path, filepath);
+
+        resolved = realpath(path, NULL);
+        free(path);
+    }
+
+    if (resolved == NULL) return NULL;
+
+    // symbolic links and .. are resolved, so the prefix can't be bypassed
+    if (0 != strncmp(resolved, file_dirprefix, strlen(file_dirprefix)))
+    {
+        free(resolved);
+        return NULL;
+    }
+
+    return resolved;
+}
+
+static int run_as_daemon(void) __attribute__((noinline));
+static int run_as_daemon(void)
+{
+    int err;
+
+    printf("Running as daemon...\n");
+
+    err = daemon(0, 0);
+    if (err < 0)
+    {
+        fprintf(stderr, "Error running as daemon: %i\n", err);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int open_socket(void) __attribute__((noinline));
+static int open_socket(void)
+{
+    struct sockaddr_un addr;
+    mode_t old_mask;
+    int err;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "Error creating socket\n");
+        return -2;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    // remove socket left by previous instance
+    unlink(socket_path);
+
+    // the socket is created accessible only by the user, so that it's never accessible with the default umask
+    old_mask = umask(0177);
+    err = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+
+    if (err < 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        fprintf(stderr, "Error binding socket: %s\n", socket_path);
+        return -3;
+    }
+
+    if (chmod(socket_path, socket_mode) < 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+        fprintf(stderr, "Error setting socket permissions: %s\n", socket_path);
+        return -5;
+    }
+
+    if (listen(listen_fd, 64) < 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+        fprintf(stderr, "Error listening on socket: %s\n", socket_path);
+        return -4;
+    }
+
+    return 0;
+}
+
+static void close_socket(void)
+{
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+    }
+}
+
+
+static int write_all(int fd, const void *data, unsigned int size)
+{
+    ssize_t written;
+
+    while (size != 0)
+    {
+        written = write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        data = written + (const uint8_t *)data;
+        size -= written;
+    }
+
+    return 1;
+}
+
+static int send_data(int fd, const void *data, unsigned int size)
+{
+    if (send_length + size > sizeof(send_buffer))
+    {
+        if (!write_all(fd, send_buffer, send_length)) return 0;
+        send_length = 0;
+    }
+
+    memcpy(send_buffer + send_length, data, size);
+    send_length += size;
+
+    return 1;
+}
+
+static int send_flush(int fd)
+{
+    int ok;
+
+    ok = write_all(fd, send_buffer, send_length);
+    send_length = 0;
+
+    return ok;
+}
+
+static void send_error(int fd, const char *message)
+{
+    char line[256];
+
+    snprintf(line, sizeof(line), "ERROR %s\n", message);
+    write_all(fd, line, strlen(line));
+}
+
+static int send_samples(void *user, const int16_t *samples, unsigned int num_frames)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    unsigned int index;
+
+    // swap values to little-endian
+    for (index = 0; index < num_frames * 2; index++)
+    {
+        swap_buffer[index] = (int16_t)(((uint16_t)samples[index] >> 8) | ((uint16_t)samples[index] << 8));
+    }
+    samples = swap_buffer;
+#endif
+
+    return send_data(*(int *)user, samples, num_frames * 2 * sizeof(int16_t));
+}
+
+static int read_request(int fd, char *header, unsigned int *header_length, unsigned int *data_offset)
+{
+    unsigned int length;
+    ssize_t read_bytes;
+    char *end;
+
+    // read until the empty line which terminates the header
+    length = 0;
+    while (1)
+    {
+        read_bytes = read(fd, header + length, REQUEST_HEADER_SIZE - length);
+        if (read_bytes < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (read_bytes == 0) return -2;
+
+        length += read_bytes;
+        header[length] = 0;
+
+        end = strstr(header, "\n\n");
+        if (end == NULL)
+        {
+            end = strstr(header, "\r\n\r\n");
+            if (end != NULL)
+            {
+                *end = 0;
+                *data_offset = (end + 4) - header;
+                break;
+            }
+        }
+        else
+        {
+            *end = 0;
+            *data_offset = (end + 2) - header;
+            break;
+        }
+
+        if (length >= REQUEST_HEADER_SIZE) return -3;
+    }
+
+    *header_length = length;
+    return 0;
+}
+
+static void handle_client(int fd)
+{
+    char header[REQUEST_HEADER_SIZE + 1];
+    char *line, *next_line, *value;
+    const char *filepath;
+    char *resolved_path;
+    uint8_t *midi_data;
+    unsigned int header_length, data_offset, midi_length, timediv, total_calls;
+    int raw_output, volume, reverb, chorus, retval;
+    midi_event_info *midi_events;
+    uint64_t data_length;
+    char line_buffer[32];
+
+    if (read_request(fd, header, &header_length, &data_offset) < 0)
+    {
+        send_error(fd, "invalid request");
+        return;
+    }
+
+    // parse header
+    filepath = NULL;
+    midi_length = 0;
+    raw_output = 0;
+    volume = -1;
+    reverb = -1;
+    chorus = -1;
+    for (line = header; line != NULL; line = next_line)
+    {
+        next_line = strchr(line, '\n');
+        if (next_line != NULL)
+        {
+            *next_line = 0;
+            next_line++;
+        }
+        if ((*line != 0) && (line[strlen(line) - 1] == '\r')) line[strlen(line) - 1] = 0;
+        if (*line == 0) continue;
+
+        value = strchr(line, ' ');
+        if (value == NULL)
+        {
+            send_error(fd, "invalid request");
+            return;
+        }
+        *value = 0;
+        value++;
+
+        if (0 == strcmp(line, "FILE"))
+        {
+            if (file_dirprefix == NULL)
+            {
+                send_error(fd, "FILE requests are disabled");
+                return;
+            }
+            filepath = value;
+        }
+        else if (0 == strcmp(line, "DATA"))
+        {
+            midi_length = strtoul(value, NULL, 10);
+            if ((midi_length == 0) || (midi_length > REQUEST_DATA_SIZE))
+            {
+                send_error(fd, "invalid data length");
+                return;
+            }
+        }
+        else if (0 == strcmp(line, "FORMAT"))
+        {
+            raw_output = (0 == strcmp(value, "raw")) ? 1 : 0;
+        }
+        else if (0 == strcmp(line, "VOLUME"))
+        {
+            volume = atoi(value);
+            if (volume < 0 || volume > 200) volume = -1;
+        }
+        else if (0 == strcmp(line, "REVERB"))
+        {
+            reverb = atoi(value) ? 1 : 0;
+        }
+        else if (0 == strcmp(line, "CHORUS"))
+        {
+            chorus = atoi(value) ? 1 : 0;
+        }
+        else
+        {
+            send_error(fd, "unknown request field");
+            return;
+        }
+    }
+
+    // load MIDI
+    if (midi_length != 0)
+    {
+        midi_data = (uint8_t *)malloc(midi_length);
+        if (midi_data == NULL)
+        {
+            send_error(fd, "out of memory");
+            return;
+        }
+
+        // part of the data could already be read with the header
+        if (header_length - data_offset > midi_length)
+        {
+            header_length = data_offset + midi_length;
+        }
+        memcpy(midi_data, header + data_offset, header_length - data_offset);
+        data_offset = header_length - data_offset;
+        while (data_offset < midi_length)
+        {
+            ssize_t read_bytes;
+
+            read_bytes = read(fd, midi_data + data_offset, midi_length - data_offset);
+            if (read_bytes < 0)
+            {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (read_bytes == 0) break;
+
+            data_offset += read_bytes;
+        }
+
+        if (data_offset < midi_length)
+        {
+            free(midi_data);
+            send_error(fd, "error reading data");
+            return;
+        }
+
+        if (load_midi_data(midi_data, midi_length, &timediv, &midi_events))
+        {
+            free(midi_data);
+            send_error(fd, "error loading MIDI data");
+            return;
+        }
+
+        free(midi_data);
+    }
+    else if (filepath != NULL)
+    {
+        resolved_path = get_file_path(filepath);
+        if (resolved_path == NULL)
+        {
+            send_error(fd, "file not found or outside of allowed directory");
+            return;
+        }
+
+        retval = load_midi_file(resolved_path, &timediv, &midi_events);
+        free(resolved_path);
+        if (retval)
+        {
+            send_error(fd, "error loading MIDI file");
+            return;
+        }
+    }
+    else
+    {
+        send_error(fd, "no input");
+        return;
+    }
+
+    total_calls = d77r_get_total_calls(renderer, midi_events[0].time + 112000);
+    data_length = (uint64_t)total_calls * bytes_per_call;
+    if (!raw_output && (data_length > UINT32_MAX - 36))
+    {
+        free_midi_data(midi_events);
+        send_error(fd, "MIDI file too long");
+        return;
+    }
+
+    // per-job settings which don't require reinitialization of the synth
+    if (volume >= 0)
+    {
+        D77_InitializeMasterVolume(volume);
+    }
+    if (reverb >= 0)
+    {
+        D77_InitializeEffect(D77_EFFECT_Reverb, reverb);
+    }
+    if (chorus >= 0)
+    {
+        D77_InitializeEffect(D77_EFFECT_Chorus, chorus);
+    }
+
+    // response
+    snprintf(line_buffer, sizeof(line_buffer), "OK %llu\n", (unsigned long long)(data_length + (raw_output ? 0 : 44)));
+    send_length = 0;
+    if (!send_data(fd, line_buffer, strlen(line_buffer))) goto render_done;
+
+    if (!raw_output)
+    {
+        uint8_t wav_header[44];
+
+        d77r_write_wav_header(wav_header, frequency, (uint32_t)data_length);
+        if (!send_data(fd, wav_header, 44)) goto render_done;
+    }
+
+    // a render error ends the response early
+    if (d77r_render_events(renderer, midi_events, send_samples, &fd) == D77R_ERROR_SINK) goto render_done;
+
+    // the client detects an incomplete response by its length
+    send_flush(fd);
+
+render_done:
+    send_length = 0;
+    free_midi_data(midi_events);
+
+    // close the connection before resetting the synth, so that the client doesn't wait for it
+    shutdown(fd, SHUT_RDWR);
+    d77r_reset(renderer);
+}
+
+static void worker_loop(void) __attribute__((noreturn));
+static void worker_loop(void)
+{
+    struct timeval timeout;
+    int client_fd;
+
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+
+    while (1)
+    {
+        client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0)
+        {
+            if ((errno == EINTR) || (errno == ECONNABORTED)) continue;
+            _exit(1);
+        }
+
+        // don't let a stalled client block the worker
+        timeout.tv_sec = 30;
+        timeout.tv_usec = 0;
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        handle_client(client_fd);
+
+        close(client_fd);
+    }
+}
+
+static pid_t start_worker(void)
+{
+    pid_t pid;
+
+    pid = fork();
+    if (pid == 0)
+    {
+        worker_loop();
+    }
+
+    return pid;
+}
+
+static void signal_handler(int signum)
+{
+    terminate = 1;
+}
+
+static int start_workers(void) __attribute__((noinline));
+static int start_workers(void)
+{
+    struct sigaction action;
+    unsigned int index;
+
+    // the workers are forked from the initialized synth
+    worker_pids = (pid_t *)calloc(num_workers, sizeof(pid_t));
+    if (worker_pids == NULL)
+    {
+        fprintf(stderr, "Error allocating memory\n");
+        return -1;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = signal_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (index = 0; index < num_workers; index++)
+    {
+        worker_pids[index] = start_worker();
+        if (worker_pids[index] < 0)
+        {
+            fprintf(stderr, "Error starting worker process\n");
+            return -2;
+        }
+    }
+
+    return 0;
+}
+
+static void stop_workers(void)
+{
+    unsigned int index;
+
+    if (worker_pids == NULL) return;
+
+    for (index = 0; index < num_workers; index++)
+    {
+        if (worker_pids[index] > 0) kill(worker_pids[index], SIGTERM);
+    }
+
+    for (index = 0; index < num_workers; index++)
+    {
+        if (worker_pids[index] > 0) waitpid(worker_pids[index], NULL, 0);
+    }
+
+    free(worker_pids);
+    worker_pids = NULL;
+}
+
+static void main_loop(void) __attribute__((noinline));
+static void main_loop(void)
+{
+    unsigned int index;
+    pid_t pid;
+    int status;
+
+    while (!terminate)
+    {
+        pid = wait(&status);
+        if (pid < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // restart worker which exited
+        for (index = 0; index < num_workers; index++)
+        {
+            if (worker_pids[index] == pid)
+            {
+                if (terminate) break;
+
+                worker_pids[index] = start_worker();
+                if (worker_pids[index] < 0)
+                {
+                    fprintf(stderr, "Error starting worker process\n");
+                }
+                break;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    read_arguments(argc, argv);
+
+    if (open_file_directory() < 0)
+    {
+        return 1;
+    }
+
+    if (start_synth() < 0)
+    {
+        return 2;
+    }
+
+    if (open_socket() < 0)
+    {
+        stop_synth();
+        return 3;
+    }
+
+    if (daemonize)
+    {
+        if (run_as_daemon() < 0)
+        {
+            close_socket();
+            stop_synth();
+            return 4;
+        }
+    }
+
+    if (start_workers() < 0)
+    {
+        stop_workers();
+        close_socket();
+        stop_synth();
+        return 5;
+    }
+
+    main_loop();
+
+    stop_workers();
+    close_socket();
+    stop_synth();
+    return 0;
+}
+
@@ -76,6 +76,22 @@ extern const struct
     uint8_t *value;
 } symbol_table_32bit[];
 
+#if defined(EMBEDDED_LIBRARY) && !defined(_WIN32) && !defined(__APPLE__)
+// library image embedded into the executable (EMBEDDED_LIBRARY is the path to the library as string)
+// aligned to the largest page size (64 KiB on aarch64), so the segments can be mapped from the executable file
+__asm__(
+    ".section .rodata\n"
+    ".balign 65536\n"
+    "embedded_library_start_32bit:\n"
+    ".incbin \"" EMBEDDED_LIBRARY "\"\n"
+    "embedded_library_end_32bit:\n"
+    ".previous\n"
+);
+
+extern const uint8_t embedded_library_start_32bit[] __asm__("embedded_library_start_32bit");
+extern const uint8_t embedded_library_end_32bit[] __asm__("embedded_library_end_32bit");
+#endif
+
 // ELF Format Cheatsheet:
 // https://gist.github.com/x0nu11byt3/bcb35c3de461e5fb66173071a2379779
 
@@ -1532,7 +1548,7 @@ error1:
     return NULL;
 }
 
-static uint8_t *load_library_from_memory_linux(int fd, uint8_t *mem, uint64_t *libsize)
+static uint8_t *load_library_from_memory_linux(int fd, uint64_t fd_offset, uint8_t *mem, uint64_t *libsize)
 {
     Elf64_Ehdr *elf_header;
     Elf64_Phdr *program_header;
@@ -1665,9 +1681,9 @@ static uint8_t *load_library_from_memory_linux(int fd, uint8_t *mem, uint64_t *l
         if (program_header->p_flags & PF_W) prot |= PROT_WRITE;
         if (program_header->p_flags & PF_R) prot |= PROT_READ;
 
-        if ((page_offset == 0) && (program_header->p_filesz == program_header->p_memsz) && !(program_header->p_offset & (page_size - 1)))
+        if ((fd >= 0) && (page_offset == 0) && (program_header->p_filesz == program_header->p_memsz) && !((fd_offset + program_header->p_offset) & (page_size - 1)))
         {
-            segment = (uint8_t *)mmap(start, program_header->p_filesz, prot, MAP_PRIVATE | MAP_FIXED, fd, program_header->p_offset);
+            segment = (uint8_t *)mmap(start, program_header->p_filesz, prot, MAP_PRIVATE | MAP_FIXED, fd, fd_offset + program_header->p_offset);
             if (segment == MAP_FAILED) goto error2;
         }
         else
@@ -1702,6 +1718,153 @@ error1:
     return NULL;
 }
 
+static int initialize_library_linux(uint8_t *library)
+{
+    int index, indrel, indsymb;
+    uint64_t section_offset, relsize, reladdr;
+    Elf64_Ehdr *elf_header;
+    Elf64_Phdr *program_header;
+    Elf64_Dyn *dynamic_entry;
+    Elf64_Rela *relocation;
+    Elf64_Sym *symbol;
+    const char *symbname;
+    void *symbvalue;
+    uint64_t dynamic_entries[DT_NUM+1];
+
+    elf_header = (Elf64_Ehdr *)library;
+
+    if ((elf_header->e_machine != EM_X86_64) && (elf_header->e_machine != EM_AARCH64) && (elf_header->e_machine != EM_RISCV))
+    {
+        fprintf(stderr, "Error: unsuported machine type\n");
+        return 0;
+    }
+
+    // read dynamic entries
+    memset(dynamic_entries, 0, sizeof(dynamic_entries));
+    for (index = 0; index < elf_header->e_phnum; index++)
+    {
+        program_header = (Elf64_Phdr *)(library + elf_header->e_phoff + index * elf_header->e_phentsize);
+
+        if (program_header->p_type != PT_DYNAMIC) continue;
+
+        for (section_offset = 0; section_offset < program_header->p_memsz; section_offset += sizeof(Elf64_Dyn))
+        {
+            dynamic_entry = (Elf64_Dyn *)(library + program_header->p_vaddr + section_offset);
+
+            if (dynamic_entry->d_tag < sizeof(dynamic_entries) / sizeof(dynamic_entries[0]))
+            {
+                dynamic_entries[dynamic_entry->d_tag] = dynamic_entry->d_un.d_val;
+            }
+        }
+    }
+
+    // unsupported: loading libraries
+
+    // apply relocations and external symbols
+    if (dynamic_entries[DT_RELSZ] != 0)
+    {
+        fprintf(stderr, "Error: unsuported relocation section type\n");
+        return 0;
+    }
+
+    for (indrel = 0; indrel < 2; indrel++)
+    {
+        if (indrel == 0)
+        {
+            if (dynamic_entries[DT_RELASZ] == 0) continue;
+            if (dynamic_entries[DT_RELA] == 0 || dynamic_entries[DT_RELAENT] == 0) return 0;
+            relsize = dynamic_entries[DT_RELASZ];
+            reladdr = dynamic_entries[DT_RELA];
+        }
+        else
+        {
+            if (dynamic_entries[DT_PLTRELSZ] == 0) continue;
+            if (dynamic_entries[DT_JMPREL] == 0 || dynamic_entries[DT_RELAENT] == 0) return 0;
+            relsize = dynamic_entries[DT_PLTRELSZ];
+            reladdr = dynamic_entries[DT_JMPREL];
+        }
+
+        for (section_offset = 0; section_offset < relsize; section_offset += dynamic_entries[DT_RELAENT])
+        {
+            relocation = (Elf64_Rela *)(library + reladdr + section_offset);
+            if (((elf_header->e_machine == EM_X86_64) && ((relocation->r_info & 0xffffffff) == R_X86_64_JUMP_SLOT)) ||
+                ((elf_header->e_machine == EM_AARCH64) && ((relocation->r_info & 0xffffffff) == R_AARCH64_JUMP_SLOT)) ||
+                ((elf_header->e_machine == EM_RISCV) && ((relocation->r_info & 0xffffffff) == R_RISCV_JUMP_SLOT))
+               )
+            {
+                if (dynamic_entries[DT_SYMTAB] == 0 || dynamic_entries[DT_SYMENT] == 0) return 0;
+
+                symbol = (Elf64_Sym *)(library + dynamic_entries[DT_SYMTAB] + ((uint32_t)(relocation->r_info >> 32)) * dynamic_entries[DT_SYMENT]);
+
+                if (symbol->st_shndx == 0)
+                {
+                    // external symbol
+                    if (symbol->st_name != 0)
+                    {
+                        if (dynamic_entries[DT_STRTAB] == 0) return 0;
+
+                        symbname = (const char *)(library + dynamic_entries[DT_STRTAB] + symbol->st_name);
+
+                        symbvalue = NULL;
+                        for (indsymb = 0; symbol_table_32bit[indsymb].name != NULL; indsymb++)
+                        {
+                            if (0 == strcmp(symbname, symbol_table_32bit[indsymb].name))
+                            {
+                                symbvalue = symbol_table_32bit[indsymb].value;
+                                break;
+                            }
+                        }
+
+                        if (symbvalue == NULL)
+                        {
+                            fprintf(stderr, "Error: symbol not found: %s\n", symbname);
+                            return 0;
+                        }
+
+                        *(uint64_t *)(library + relocation->r_offset) = (uintptr_t)symbvalue;
+                    }
+                }
+                else
+                {
+                    // internal symbol
+                    *(uint64_t *)(library + relocation->r_offset) = (uintptr_t)(library + symbol->st_value);
+                }
+            }
+            else if (((elf_header->e_machine == EM_X86_64) && ((relocation->r_info & 0xffffffff) == R_X86_64_RELATIVE)) ||
+                     ((elf_header->e_machine == EM_AARCH64) && ((relocation->r_info & 0xffffffff) == R_AARCH64_RELATIVE)) ||
+                     ((elf_header->e_machine == EM_RISCV) && ((relocation->r_info & 0xffffffff) == R_RISCV_RELATIVE))
+                    )
+            {
+                *(uint64_t *)(library + relocation->r_offset) = (uintptr_t)(library + relocation->r_addend);
+            }
+            else
+            {
+                fprintf(stderr, "Error: unsuported relocation type\n");
+                return 0;
+            }
+        }
+    }
+
+    // run constructors
+    if (dynamic_entries[DT_INIT] != 0)
+    {
+        // run constructor
+        ((void (*)(void)) (library + dynamic_entries[DT_INIT]))();
+    }
+    if (dynamic_entries[DT_INIT_ARRAYSZ] != 0)
+    {
+        if (dynamic_entries[DT_INIT_ARRAY] == 0) return 0;
+
+        for (section_offset = 0; section_offset < dynamic_entries[DT_INIT_ARRAYSZ]; section_offset += sizeof(uint64_t))
+        {
+            // run constructor
+            ((void (*)(void))*(uint64_t *)(library + dynamic_entries[DT_INIT_ARRAY] + section_offset) )();
+        }
+    }
+
+    return 1;
+}
+
 #endif
 
 void *load_library_32bit(const char *libpath)
@@ -2065,18 +2228,10 @@ error1:
     munmap(library, libsize);
     return NULL;
 #else
-    int fd, index, indrel, indsymb;
+    int fd;
     off_t len;
     uint8_t *mem, *library;
-    uint64_t libsize, section_offset, relsize, reladdr;
-    Elf64_Ehdr *elf_header;
-    Elf64_Phdr *program_header;
-    Elf64_Dyn *dynamic_entry;
-    Elf64_Rela *relocation;
-    Elf64_Sym *symbol;
-    const char *symbname;
-    void *symbvalue;
-    uint64_t dynamic_entries[DT_NUM+1];
+    uint64_t libsize;
 
     if (sizeof(void *) != 8) return NULL;
 
@@ -2095,7 +2250,7 @@ error1:
     mem = (uint8_t *) mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
     if (mem != MAP_FAILED)
     {
-        library = load_library_from_memory_linux(fd, mem, &libsize);
+        library = load_library_from_memory_linux(fd, 0, mem, &libsize);
         munmap(mem, len);
         close(fd);
     }
@@ -2107,144 +2262,95 @@ error1:
 
     if (library == NULL) return NULL;
 
-    elf_header = (Elf64_Ehdr *)library;
-
-    if ((elf_header->e_machine != EM_X86_64) && (elf_header->e_machine != EM_AARCH64) && (elf_header->e_machine != EM_RISCV))
+    if (!initialize_library_linux(library))
     {
-        fprintf(stderr, "Error: unsuported machine type\n");
-        goto error1;
+        munmap(library, libsize);
+        return NULL;
     }
 
-    // read dynamic entries
-    memset(dynamic_entries, 0, sizeof(dynamic_entries));
-    for (index = 0; index < elf_header->e_phnum; index++)
-    {
-        program_header = (Elf64_Phdr *)(library + elf_header->e_phoff + index * elf_header->e_phentsize);
-
-        if (program_header->p_type != PT_DYNAMIC) continue;
+    return library;
+#endif
+}
 
-        for (section_offset = 0; section_offset < program_header->p_memsz; section_offset += sizeof(Elf64_Dyn))
-        {
-            dynamic_entry = (Elf64_Dyn *)(library + program_header->p_vaddr + section_offset);
+#ifdef EMBEDDED_LIBRARY
+#if !defined(_WIN32) && !defined(__APPLE__)
+static int find_embedded_library_linux(uint64_t *exe_offset)
+{
+    FILE *f;
+    char line[512];
+    unsigned long long start, end, offset;
+    uintptr_t addr;
+    int fd;
+    Elf64_Ehdr elf_header;
 
-            if (dynamic_entry->d_tag < sizeof(dynamic_entries) / sizeof(dynamic_entries[0]))
-            {
-                dynamic_entries[dynamic_entry->d_tag] = dynamic_entry->d_un.d_val;
-            }
-        }
-    }
+    // find offset of the embedded library in the executable file, so the segments can be mapped from the file
+    addr = (uintptr_t)embedded_library_start_32bit;
+    fd = -1;
 
-    // unsupported: loading libraries
+    f = fopen("/proc/self/maps", "r");
+    if (f == NULL) return -1;
 
-    // apply relocations and external symbols
-    if (dynamic_entries[DT_RELSZ] != 0)
+    while (fgets(line, sizeof(line), f) != NULL)
     {
-        fprintf(stderr, "Error: unsuported relocation section type\n");
-        goto error1;
+        if (sscanf(line, "%llx-%llx %*s %llx", &start, &end, &offset) != 3) continue;
+        if ((addr < start) || (addr >= end)) continue;
+
+        fd = open("/proc/self/exe", O_RDONLY);
+        *exe_offset = offset + (addr - start);
+        break;
     }
 
-    for (indrel = 0; indrel < 2; indrel++)
-    {
-        if (indrel == 0)
-        {
-            if (dynamic_entries[DT_RELASZ] == 0) continue;
-            if (dynamic_entries[DT_RELA] == 0 || dynamic_entries[DT_RELAENT] == 0) goto error1;
-            relsize = dynamic_entries[DT_RELASZ];
-            reladdr = dynamic_entries[DT_RELA];
-        }
-        else
-        {
-            if (dynamic_entries[DT_PLTRELSZ] == 0) continue;
-            if (dynamic_entries[DT_JMPREL] == 0 || dynamic_entries[DT_RELAENT] == 0) goto error1;
-            relsize = dynamic_entries[DT_PLTRELSZ];
-            reladdr = dynamic_entries[DT_JMPREL];
-        }
+    fclose(f);
 
-        for (section_offset = 0; section_offset < relsize; section_offset += dynamic_entries[DT_RELAENT])
-        {
-            relocation = (Elf64_Rela *)(library + reladdr + section_offset);
-            if (((elf_header->e_machine == EM_X86_64) && ((relocation->r_info & 0xffffffff) == R_X86_64_JUMP_SLOT)) ||
-                ((elf_header->e_machine == EM_AARCH64) && ((relocation->r_info & 0xffffffff) == R_AARCH64_JUMP_SLOT)) ||
-                ((elf_header->e_machine == EM_RISCV) && ((relocation->r_info & 0xffffffff) == R_RISCV_JUMP_SLOT))
-               )
-            {
-                if (dynamic_entries[DT_SYMTAB] == 0 || dynamic_entries[DT_SYMENT] == 0) goto error1;
+    if (fd < 0) return -1;
 
-                symbol = (Elf64_Sym *)(library + dynamic_entries[DT_SYMTAB] + ((uint32_t)(relocation->r_info >> 32)) * dynamic_entries[DT_SYMENT]);
+    // check that the file contains the embedded library at the found offset
+    if ((pread(fd, &elf_header, sizeof(Elf64_Ehdr), *exe_offset) != sizeof(Elf64_Ehdr)) ||
+        memcmp(&elf_header, embedded_library_start_32bit, sizeof(Elf64_Ehdr))
+       )
+    {
+        close(fd);
+        return -1;
+    }
 
-                if (symbol->st_shndx == 0)
-                {
-                    // external symbol
-                    if (symbol->st_name != 0)
-                    {
-                        if (dynamic_entries[DT_STRTAB] == 0) goto error1;
+    return fd;
+}
+#endif
 
-                        symbname = (const char *)(library + dynamic_entries[DT_STRTAB] + symbol->st_name);
+void *load_embedded_library_32bit(void)
+{
+#if defined(_WIN32) || defined(__APPLE__)
+    // unsupported: embedded library
+    return NULL;
+#else
+    int fd;
+    uint64_t exe_offset;
+    uint8_t *library;
+    uint64_t libsize;
 
-                        symbvalue = NULL;
-                        for (indsymb = 0; symbol_table_32bit[indsymb].name != NULL; indsymb++)
-                        {
-                            if (0 == strcmp(symbname, symbol_table_32bit[indsymb].name))
-                            {
-                                symbvalue = symbol_table_32bit[indsymb].value;
-                                break;
-                            }
-                        }
+    if (sizeof(void *) != 8) return NULL;
 
-                        if (symbvalue == NULL)
-                        {
-                            fprintf(stderr, "Error: symbol not found: %s\n", symbname);
-                            goto error1;
-                        }
+    if ((uint64_t)(embedded_library_end_32bit - embedded_library_start_32bit) < sizeof(Elf64_Ehdr)) return NULL;
 
-                        *(uint64_t *)(library + relocation->r_offset) = (uintptr_t)symbvalue;
-                    }
-                }
-                else
-                {
-                    // internal symbol
-                    *(uint64_t *)(library + relocation->r_offset) = (uintptr_t)(library + symbol->st_value);
-                }
-            }
-            else if (((elf_header->e_machine == EM_X86_64) && ((relocation->r_info & 0xffffffff) == R_X86_64_RELATIVE)) ||
-                     ((elf_header->e_machine == EM_AARCH64) && ((relocation->r_info & 0xffffffff) == R_AARCH64_RELATIVE)) ||
-                     ((elf_header->e_machine == EM_RISCV) && ((relocation->r_info & 0xffffffff) == R_RISCV_RELATIVE))
-                    )
-            {
-                *(uint64_t *)(library + relocation->r_offset) = (uintptr_t)(library + relocation->r_addend);
-            }
-            else
-            {
-                fprintf(stderr, "Error: unsuported relocation type\n");
-                goto error1;
-            }
-        }
-    }
+    // segments are mapped from the executable file if possible, otherwise they are copied from the embedded image
+    // library linked at fixed address (ET_EXEC) is loaded without any relocations
+    exe_offset = 0;
+    fd = find_embedded_library_linux(&exe_offset);
+    library = load_library_from_memory_linux(fd, exe_offset, (uint8_t *)embedded_library_start_32bit, &libsize);
+    if (fd >= 0) close(fd);
 
-    // run constructors
-    if (dynamic_entries[DT_INIT] != 0)
-    {
-        // run constructor
-        ((void (*)(void)) (library + dynamic_entries[DT_INIT]))();
-    }
-    if (dynamic_entries[DT_INIT_ARRAYSZ] != 0)
-    {
-        if (dynamic_entries[DT_INIT_ARRAY] == 0) goto error1;
+    if (library == NULL) return NULL;
 
-        for (section_offset = 0; section_offset < dynamic_entries[DT_INIT_ARRAYSZ]; section_offset += sizeof(uint64_t))
-        {
-            // run constructor
-            ((void (*)(void))*(uint64_t *)(library + dynamic_entries[DT_INIT_ARRAY] + section_offset) )();
-        }
+    if (!initialize_library_linux(library))
+    {
+        munmap(library, libsize);
+        return NULL;
     }
 
     return library;
-
-error1:
-    munmap(library, libsize);
-    return NULL;
 #endif
 }
+#endif
 
 void *find_symbol_32bit(void *library, const char *name)
 {
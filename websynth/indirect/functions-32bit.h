@@ -33,6 +33,9 @@ void *map_memory_32bit(unsigned int size, int only_address_space);
 void unmap_memory_32bit(void *mem, unsigned int size);
 
 void *load_library_32bit(const char *libpath);
+#ifdef EMBEDDED_LIBRARY
+void *load_embedded_library_32bit(void);
+#endif
 void *find_symbol_32bit(void *library, const char *name);
 void unload_library_32bit(void *library);
 
@@ -51,7 +51,7 @@ typedef struct
     uint32_t dwRevFb;           // 0-200        load default: 90    .ini value: 95      validation value: 200
     uint32_t dwRevDrm;          // 0-200        load default: 90    .ini value: 80      validation value: 200
     uint32_t dwResoUpAdj;       // 0-100        load default: 55    .ini value: 40      validation value: 100
-    uint32_t dwCacheSize;       // 1-20         load default: 10    .ini value: 3       validation value: 1/20
+    uint32_t dwCacheSize;       // 1-20         load default: 10    .ini value: 3       validation value: 1/20  (only validated, samples are played directly from the datafile)
     uint32_t dwTimeReso;        // 40/80        load default: 80    .ini value: 80      validation value: 80
 } D77_SETINGS;
 #pragma pack()
@@ -86,7 +86,12 @@ EXTERNC int D77_LoadLibrary(const char *libpath)
 {
     if (library != NULL) return 0;
 
+#ifdef EMBEDDED_LIBRARY
+    // without path, the library embedded in the executable is used
+    library = (libpath != NULL) ? load_library_32bit(libpath) : load_embedded_library_32bit();
+#else
     library = load_library_32bit(libpath);
+#endif
     if (library == NULL) return 0;
 
     c_ValidateSettings = (void (CCALL *)(_stack *stack, void *lpSettings))find_symbol_32bit(library, "c_ValidateSettings");